@@ -0,0 +1,47 @@
+/*
+ * Measure how long it takes to parse some typical reply lines.
+ *
+ * The result is printed on Serial, in microseconds per line.
+ */
+#include <SIMCOM_Reply.h>
+
+#define ITERATIONS      1000
+
+static const char * const lines[] = {
+    "+CSQ: 18,0",
+    "+CREG: 2,1,\"1A2B\",\"3C4D\"",
+    "+HTTPACTION: 1,200,11",
+    "+HTTPREAD: 1360",
+    "+FTPPUT:1,1,1360",
+};
+static const uint8_t nrLines = sizeof(lines) / sizeof(lines[0]);
+
+void setup() {
+  Serial.begin(9600);
+  while (!Serial && millis() < 5000) {
+  }
+
+  int a;
+  int b;
+  int c;
+  long l;
+  char str[8];
+  int total = 0;
+  uint32_t start = micros();
+  for (uint16_t i = 0; i < ITERATIONS; ++i) {
+    total += SIMCOM_scanReply(lines[0], PSTR("+CSQ: %d,%d"), &a, &b);
+    total += SIMCOM_scanReply(lines[1], PSTR("+CREG: %*,%d,%s"), &a, str, sizeof(str));
+    total += SIMCOM_scanReply(lines[2], PSTR("+HTTPACTION: %d,%d,%d"), &a, &b, &c);
+    total += SIMCOM_scanReply(lines[3], PSTR("+HTTPREAD: %l"), &l);
+    total += SIMCOM_scanReply(lines[4], PSTR("+FTPPUT: %d,%d,%l"), &a, &b, &l);
+  }
+  uint32_t elapsed = micros() - start;
+
+  Serial.print(F("fields: "));
+  Serial.println(total);
+  Serial.print(F("us per line: "));
+  Serial.println((float)elapsed / ((uint32_t)ITERATIONS * nrLines));
+}
+
+void loop() {
+}
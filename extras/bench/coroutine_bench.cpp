@@ -0,0 +1,164 @@
+/*
+ * Coroutines versus a thread per modem: memory per modem and the cost
+ * of a switch.
+ *
+ * The simulated modems reply at once, so the time per command is the
+ * cost of the engine plus one suspend and resume. For threads the cost
+ * of a round trip between two threads (two switches) is measured.
+ *
+ * This is a host program that needs C++20, see modem_pool_bench.cpp for
+ * how to build it (add -std=c++20).
+ */
+#include <Arduino.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <string.h>
+#include <thread>
+
+#include "SIMCOM_Coroutine.h"
+#include "SIMx00.h"
+
+#define MODEMS          64
+#define COMMANDS        2000
+#define ROUND_TRIPS     20000
+
+static size_t allocated;
+
+void * operator new(size_t size)
+{
+    allocated += size;
+    void * ptr = malloc(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void * ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void * ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+static double elapsedNs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Answers OK to every command
+class InstantModem : public Stream {
+public:
+    InstantModem() : _pending(0), _pos(0) {}
+    int available() { return _pending ? 4 - _pos : 0; }
+    int peek() { return _pending ? "\r\nOK\r\n"[2 + _pos] : -1; }
+    int read()
+    {
+        if (!_pending) {
+            return -1;
+        }
+        int c = "OK\r\n"[_pos++];
+        if (_pos == 4) {
+            _pending = false;
+            _pos = 0;
+        }
+        return c;
+    }
+    size_t write(uint8_t c)
+    {
+        if (c == '\r') {
+            _pending = true;
+            _pos = 0;
+        }
+        return 1;
+    }
+private:
+    bool _pending;
+    uint8_t _pos;
+};
+
+static SIMCOM_Task<void> commands(SIMCOM_CoModem & modem, int nr, int * ok)
+{
+    for (int i = 0; i < nr; ++i) {
+        if ((co_await modem.command("AT")).ok()) {
+            ++*ok;
+        }
+    }
+}
+
+int main()
+{
+    static InstantModem streams[MODEMS];
+    static int ok[MODEMS];
+    SIMCOM_VirtualClock clock;
+    SIMCOM_CoScheduler scheduler;
+    SIMCOM_CoModem * modems[MODEMS];
+    for (int i = 0; i < MODEMS; ++i) {
+        modems[i] = new SIMCOM_CoModem(scheduler, streams[i], clock);
+    }
+
+    size_t before = allocated;
+    for (int i = 0; i < MODEMS; ++i) {
+        scheduler.spawn(commands(*modems[i], COMMANDS, &ok[i]));
+    }
+    size_t frames = allocated - before;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    scheduler.run(clock);
+    double ns = elapsedNs(start);
+    int total = 0;
+    for (int i = 0; i < MODEMS; ++i) {
+        total += ok[i];
+    }
+
+    printf("coroutines: %d modems on one thread\n", MODEMS);
+    printf("  memory per modem: %zu bytes (modem) + %zu bytes (task frame)\n",
+            sizeof(SIMCOM_CoModem), frames / MODEMS);
+    printf("  %d commands, %.0f ns per command (suspend + resume included)\n", total, ns / total);
+
+    // Thread per modem
+    pthread_attr_t attr;
+    size_t stack = 0;
+    pthread_attr_init(&attr);
+    pthread_attr_getstacksize(&attr, &stack);
+    pthread_attr_destroy(&attr);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    int turn = 0;
+    std::thread other([&] {
+        for (int i = 0; i < ROUND_TRIPS; ++i) {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return turn == 1; });
+            turn = 0;
+            cv.notify_one();
+        }
+    });
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUND_TRIPS; ++i) {
+        std::unique_lock<std::mutex> lock(mutex);
+        turn = 1;
+        cv.notify_one();
+        cv.wait(lock, [&] { return turn == 0; });
+    }
+    ns = elapsedNs(start);
+    other.join();
+
+    printf("threads: one per modem\n");
+    printf("  memory per modem: %zu bytes (SIMx00T<64>) + %zu bytes (default stack, reserved)\n",
+            sizeof(SIMx00T<64>), stack);
+    printf("  %.0f ns per round trip between two threads\n", ns / ROUND_TRIPS);
+
+    for (int i = 0; i < MODEMS; ++i) {
+        delete modems[i];
+    }
+    return 0;
+}
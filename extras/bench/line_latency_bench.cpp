@@ -0,0 +1,144 @@
+/*
+ * Line delivery latency, with and without the I/O thread.
+ *
+ * A simulated modem on the slave side of a pty writes LINES reply
+ * lines, one every INTERVAL_US, or a reply of BURST lines at a time. The application reads the master side,
+ * either directly (SIMCOM_PosixSerial, byte by byte) or through
+ * SIMCOM_ThreadedSerial (whole lines), and measures the time from the
+ * write until it has the line, and the CPU time the application thread
+ * spent per line.
+ *
+ * This is a host program, see modem_pool_bench.cpp for how to build it.
+ */
+#include <Arduino.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "SIMCOM_PosixSerial.h"
+#include "SIMCOM_ThreadedSerial.h"
+
+#define LINES           500
+#define INTERVAL_US     2000
+#define BURST           20
+
+static uint64_t nowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t threadCpuNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static std::atomic<uint64_t> sentAt[LINES];
+
+static void simulatedModem(const char * name, int burst)
+{
+    int fd = open(name, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+    static const char line[] = "+CSQ: 18,0\r\n";
+    char reply[BURST * sizeof(line)];
+    for (int i = 0; i < burst; ++i) {
+        memcpy(reply + i * (sizeof(line) - 1), line, sizeof(line) - 1);
+    }
+    for (int i = 0; i < LINES; i += burst) {
+        usleep(INTERVAL_US * burst);
+        uint64_t now = nowMicros();
+        for (int j = i; j < i + burst; ++j) {
+            sentAt[j] = now;
+        }
+        (void)write(fd, reply, burst * (sizeof(line) - 1));
+    }
+    usleep(100000);
+    close(fd);
+}
+
+// Bytes until the line end, the way SIMCOM_Modem::readLine() reads a Stream
+static int nextLine(SIMCOM_PosixSerial & stream, char * buffer, size_t size)
+{
+    size_t len = 0;
+    while (stream.waitForInput(1000)) {
+        int c;
+        while ((c = stream.read()) >= 0) {
+            if (c == '\n') {
+                buffer[len] = 0;
+                return len;
+            }
+            if (c != '\r' && len < size - 1) {
+                buffer[len++] = c;
+            }
+        }
+    }
+    return -1;
+}
+
+// A whole line from the I/O thread, see SIMCOM_Modem::setLineSource()
+static int nextLine(SIMCOM_ThreadedSerial & stream, char * buffer, size_t size)
+{
+    if (!stream.waitForLine(1000)) {
+        return -1;
+    }
+    return stream.readLine(buffer, size);
+}
+
+template <typename S>
+static void measure(const char * title, S & stream, const char * name, int burst)
+{
+    std::thread modem(simulatedModem, name, burst);
+    uint64_t cpu = threadCpuNanos();
+    uint64_t total = 0;
+    uint64_t max = 0;
+    int lines = 0;
+    char line[64];
+    while (lines < LINES && nextLine(stream, line, sizeof(line)) >= 0) {
+        uint64_t latency = nowMicros() - sentAt[lines++];
+        total += latency;
+        if (latency > max) {
+            max = latency;
+        }
+    }
+    cpu = threadCpuNanos() - cpu;
+    modem.join();
+    printf("%-10s burst %2d  lines %d  avg %5llu us  max %5llu us  cpu %5llu ns/line\n",
+            title, burst, lines, (unsigned long long)(lines ? total / lines : 0),
+            (unsigned long long)max, (unsigned long long)(lines ? cpu / lines : 0));
+}
+
+int main()
+{
+    char name[64];
+    SIMCOM_PosixSerial pty;
+    if (!pty.openPty(name, sizeof(name))) {
+        perror("openPty");
+        return 1;
+    }
+    // Keep the slave side open, so the master never sees a hangup
+    // between the runs
+    int slave = open(name, O_RDWR | O_NOCTTY);
+    measure("direct", pty, name, 1);
+    measure("direct", pty, name, BURST);
+
+    SIMCOM_ThreadedSerial threaded(pty.fd());
+    threaded.start();
+    measure("threaded", threaded, name, 1);
+    measure("threaded", threaded, name, BURST);
+    printf("threaded: I/O thread to application avg %u us  max %u us\n",
+            threaded.avgLineLatency(), threaded.maxLineLatency());
+    threaded.stop();
+    close(slave);
+    return 0;
+}
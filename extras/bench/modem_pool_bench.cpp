@@ -0,0 +1,95 @@
+/*
+ * Aggregate command throughput versus the number of modems.
+ *
+ * Each modem is simulated: it answers every command with OK after
+ * REPLY_MS. Every modem runs COMMANDS commands, on a pool with one
+ * thread per modem.
+ *
+ * This is a host program. Build it with the library sources and an
+ * Arduino API layer for the host, e.g. with the command below.
+ */
+// g++ -std=c++11 -I<core> -Isrc src/*.cpp <core>/*.cpp extras/bench/modem_pool_bench.cpp -lpthread
+#include <Arduino.h>
+#include <stdio.h>
+#include <deque>
+#include <mutex>
+
+#include "SIMx00.h"
+#include "SIMCOM_ModemPool.h"
+
+#define MAX_MODEMS      16
+#define COMMANDS        20
+#define REPLY_MS        20
+
+class SimulatedModem : public Stream {
+public:
+    SimulatedModem() : _replyAt(0) {}
+    int available() { std::lock_guard<std::mutex> lock(_mutex); return ready() ? _rx.size() : 0; }
+    int peek() { std::lock_guard<std::mutex> lock(_mutex); return ready() && !_rx.empty() ? _rx.front() : -1; }
+    int read()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!ready() || _rx.empty()) {
+            return -1;
+        }
+        int c = _rx.front();
+        _rx.pop_front();
+        return c;
+    }
+    size_t write(uint8_t c)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (c == '\r') {
+            static const char reply[] = "\r\nOK\r\n";
+            _rx.insert(_rx.end(), reply, reply + sizeof(reply) - 1);
+            _replyAt = millis() + REPLY_MS;
+        }
+        return 1;
+    }
+private:
+    bool ready() const { return (int32_t)(millis() - _replyAt) >= 0; }
+    std::mutex _mutex;
+    std::deque<uint8_t> _rx;
+    uint32_t _replyAt;
+};
+
+static void runCommands(SIMCOM_Modem & modem, void * arg)
+{
+    uint32_t * ok = static_cast<uint32_t *>(arg);
+    for (int i = 0; i < COMMANDS; ++i) {
+        if (modem.sendCommandWaitForOK_P(PSTR("AT"))) {
+            ++*ok;
+        }
+    }
+}
+
+int main()
+{
+    static SimulatedModem streams[MAX_MODEMS];
+    static GPRSBeeOnOff onoff[MAX_MODEMS];
+    static SIMx00T<64> modems[MAX_MODEMS];
+    static uint32_t ok[MAX_MODEMS];
+    for (int i = 0; i < MAX_MODEMS; ++i) {
+        modems[i].init(streams[i], onoff[i]);
+    }
+
+    printf("modems  commands/s  ok\n");
+    for (int n = 1; n <= MAX_MODEMS; n *= 2) {
+        SIMCOM_ModemPool pool;
+        uint32_t total = 0;
+        for (int i = 0; i < n; ++i) {
+            ok[i] = 0;
+            pool.post(modems[i], runCommands, &ok[i]);
+        }
+        uint32_t start = millis();
+        pool.start(n);
+        pool.wait();
+        uint32_t elapsed = millis() - start;
+        pool.stop();
+        for (int i = 0; i < n; ++i) {
+            total += ok[i];
+        }
+        printf("%6d  %10.1f  %u/%u\n", n, total * 1000.0 / elapsed, total, n * COMMANDS);
+    }
+    return 0;
+}
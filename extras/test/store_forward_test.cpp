@@ -0,0 +1,143 @@
+/*
+ * Checks which HTTP errors make SIMCOM_StoreForward drop records.
+ *
+ * A simulated modem answers every HTTPACTION with a fixed status, or
+ * with 400 if the body has "BAD" in it. A 404 (e.g. a wrong URL) must
+ * keep all the records. A 400 must drop only the record that caused
+ * it. Exits with 0 if all checks pass.
+ *
+ * This is a host program, see extras/bench/modem_pool_bench.cpp for
+ * how to build it.
+ */
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <string>
+
+#include "SIMx00.h"
+#include "SIMCOM_StoreForward.h"
+
+#define QUEUE_FILE      "store_forward_test.bin"
+
+class SimulatedServer : public Stream {
+public:
+    SimulatedServer(int status) : _status(status), _bodyLeft(0) {}
+    int available() { return _rx.size(); }
+    int peek() { return _rx.empty() ? -1 : _rx.front(); }
+    int read()
+    {
+        if (_rx.empty()) {
+            return -1;
+        }
+        int c = _rx.front();
+        _rx.pop_front();
+        return c;
+    }
+    size_t write(uint8_t c)
+    {
+        if (_bodyLeft > 0) {
+            _body += (char)c;
+            if (--_bodyLeft == 0) {
+                reply("\r\nOK\r\n");
+            }
+        } else if (c == '\r') {
+            command();
+            _line.clear();
+        } else if (c != '\n') {
+            _line += (char)c;
+        }
+        return 1;
+    }
+private:
+    void reply(const char * text) { _rx.insert(_rx.end(), text, text + strlen(text)); }
+    void command()
+    {
+        if (_line.compare(0, 12, "AT+HTTPDATA=") == 0) {
+            _bodyLeft = atol(_line.c_str() + 12);
+            _body.clear();
+            reply("\r\nDOWNLOAD\r\n");
+        } else if (_line == "AT+HTTPACTION=1") {
+            char urc[40];
+            int status = _body.find("BAD") != std::string::npos ? 400 : _status;
+            snprintf(urc, sizeof(urc), "\r\n+HTTPACTION: 1,%d,0\r\n", status);
+            reply("\r\nOK\r\n");
+            reply(urc);
+        } else {
+            reply("\r\nOK\r\n");
+        }
+    }
+    int _status;
+    long _bodyLeft;
+    std::string _line;
+    std::string _body;
+    std::deque<uint8_t> _rx;
+};
+
+class AlwaysOn : public SIMCOM_Modem_OnOff {
+public:
+    void on() {}
+    void off() {}
+    bool isOn() { return true; }
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char * what)
+{
+    printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) {
+        ++failures;
+    }
+}
+
+struct Result {
+    bool uploaded;
+    size_t pending;
+    uint32_t rejected;
+};
+
+// Queue the records and upload them to a server that answers with <status>
+static Result upload(int status, const char * const * records, size_t nr)
+{
+    AlwaysOn onoff;
+    SIMCOM_VirtualClock clock;
+    SimulatedServer server(status);
+    SIMx00T<96> modem;
+    modem.init(server, onoff);
+    modem.setClock(clock);
+
+    remove(QUEUE_FILE);
+    SIMCOM_FileStorage storage(QUEUE_FILE, 1024);
+    SIMCOM_StoreForward queue(storage);
+    queue.begin();
+    queue.setBatchLimit(1000, '\n');
+    for (size_t i = 0; i < nr; ++i) {
+        queue.push(records[i], strlen(records[i]));
+    }
+    Result result;
+    result.uploaded = queue.uploadHTTP(modem, "http://example.com/", "text/plain", "");
+    result.pending = queue.pending();
+    result.rejected = queue.rejected();
+    return result;
+}
+
+int main()
+{
+    static const char * const records[] = { "r1", "r2", "BAD3", "r4", "r5" };
+    const size_t nr = sizeof(records) / sizeof(records[0]);
+
+    Result result = upload(404, records, nr);
+    check(!result.uploaded, "404: the upload fails");
+    check(result.pending == nr, "404: all records are kept");
+    check(result.rejected == 0, "404: no record is dropped");
+
+    result = upload(200, records, nr);
+    check(result.uploaded, "400: the upload succeeds");
+    check(result.pending == 0, "400: the queue is drained");
+    check(result.rejected == 1, "400: only the bad record is dropped");
+
+    remove(QUEUE_FILE);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#include "SIMCOM_Body.h"
+
+size_t SIMCOM_CountingPrint::write(uint8_t value)
+{
+    if (_out && _count < _limit) {
+        _out->write(value);
+    }
+    ++_count;
+    return 1;
+}
+
+size_t SIMCOM_CountingPrint::write(const uint8_t * buffer, size_t size)
+{
+    if (_out && _count < _limit) {
+        _out->write(buffer, size < _limit - _count ? size : _limit - _count);
+    }
+    _count += size;
+    return size;
+}
+
+size_t SIMCOM_BodyProducer::length()
+{
+    SIMCOM_CountingPrint counter;
+    render(counter);
+    return counter.count();
+}
+
+void SIMCOM_IOVecBody::render(Print & out)
+{
+    for (size_t i = 0; i < _nr; ++i) {
+        const uint8_t * ptr = static_cast<const uint8_t *>(_iov[i].data);
+        size_t len = _iov[i].len;
+        if (!_iov[i].progmem) {
+            out.write(ptr, len);
+            continue;
+        }
+        // Copy from flash in small chunks
+        uint8_t chunk[16];
+        while (len > 0) {
+            size_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+            memcpy_P(chunk, ptr, n);
+            out.write(chunk, n);
+            ptr += n;
+            len -= n;
+        }
+    }
+}
+
+size_t SIMCOM_IOVecBody::length()
+{
+    size_t len = 0;
+    for (size_t i = 0; i < _nr; ++i) {
+        len += _iov[i].len;
+    }
+    return len;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_BODY_h
+#define _SIMCOM_BODY_h
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <Print.h>
+
+/*!
+ * \brief A Print that counts the bytes written to it
+ *
+ * If an output Print is given the bytes are passed on, otherwise
+ * they are discarded. Use it without output to measure the length
+ * of something before sending it.
+ */
+class SIMCOM_CountingPrint : public Print {
+public:
+    SIMCOM_CountingPrint(Print * out = NULL) : _out(out), _count(0), _limit((size_t)-1) {}
+
+    size_t write(uint8_t value);
+    size_t write(const uint8_t * buffer, size_t size);
+    using Print::write;
+
+    // Returns the number of bytes written so far.
+    size_t count() const { return _count; }
+    void reset() { _count = 0; }
+
+    // Bytes after the first <limit> are counted, but not written
+    void setLimit(size_t limit) { _limit = limit; }
+
+private:
+    Print * _out;
+    size_t _count;
+    size_t _limit;
+};
+
+/*!
+ * \brief The producer of a request body (HTTP POST, TCP data)
+ *
+ * AT+HTTPDATA and AT+CIPSEND need the length up front, so by default
+ * render() is called twice. The first time the output only counts
+ * the bytes, the second time the output is the modem stream.
+ * Both calls must produce exactly the same bytes.
+ */
+class SIMCOM_BodyProducer {
+public:
+    virtual ~SIMCOM_BodyProducer() {}
+    virtual void render(Print & out) = 0;
+
+    // Returns the length of the body. The default renders it into a
+    // counting Print. Override it if the length is known beforehand.
+    virtual size_t length();
+};
+
+/*!
+ * \brief A body that is already in RAM
+ */
+class SIMCOM_BufferBody : public SIMCOM_BodyProducer {
+public:
+    SIMCOM_BufferBody(const void * data, size_t len) : _data(data), _len(len) {}
+    void render(Print & out) { out.write(static_cast<const uint8_t *>(_data), _len); }
+    size_t length() { return _len; }
+
+private:
+    const void * _data;
+    size_t _len;
+};
+
+/*!
+ * \brief One fragment of a scatter-gather body
+ *
+ * If progmem is true the data is in flash (PROGMEM).
+ */
+struct SIMCOM_IOVec {
+    const void * data;
+    size_t len;
+    bool progmem;
+};
+
+/*!
+ * \brief A body made of a list of fragments, sent back to back
+ *
+ * For example a header, the payload of a sensor driver and a CRC
+ * trailer. No copy of the whole body is needed.
+ */
+class SIMCOM_IOVecBody : public SIMCOM_BodyProducer {
+public:
+    SIMCOM_IOVecBody(const SIMCOM_IOVec * iov, size_t nr) : _iov(iov), _nr(nr) {}
+    void render(Print & out);
+    size_t length();
+
+private:
+    const SIMCOM_IOVec * _iov;
+    size_t _nr;
+};
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+
+#include "SIMCOM_Clock.h"
+
+SIMCOM_ArduinoClock SIMCOM_arduinoClock;
+
+uint32_t SIMCOM_ArduinoClock::millis()
+{
+    return ::millis();
+}
+
+uint32_t SIMCOM_ArduinoClock::micros()
+{
+    return ::micros();
+}
+
+void SIMCOM_ArduinoClock::delay(uint32_t ms)
+{
+    ::delay(ms);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_CLOCK_h
+#define _SIMCOM_CLOCK_h
+
+#include <stdint.h>
+
+/*!
+ * \brief The source of time for the modem code
+ *
+ * idle() is called while the modem code is waiting for input.
+ */
+class SIMCOM_Clock {
+public:
+    virtual ~SIMCOM_Clock() {}
+    virtual uint32_t millis() = 0;
+    virtual uint32_t micros() = 0;
+    virtual void delay(uint32_t ms) = 0;
+    virtual void idle() {}
+};
+
+/*!
+ * \brief The clock of the Arduino core (millis(), micros() and delay())
+ */
+class SIMCOM_ArduinoClock : public SIMCOM_Clock {
+public:
+    uint32_t millis();
+    uint32_t micros();
+    void delay(uint32_t ms);
+};
+
+// The default clock
+extern SIMCOM_ArduinoClock SIMCOM_arduinoClock;
+
+/*!
+ * \brief A clock that only moves when it is told to
+ *
+ * delay() returns at once and moves the time forward. While the
+ * modem code waits for input the time moves one step per poll. This
+ * makes it possible to test long timeouts, e.g. a 120 seconds wait
+ * for network registration, with a simulated modem in milliseconds.
+ */
+class SIMCOM_VirtualClock : public SIMCOM_Clock {
+public:
+    SIMCOM_VirtualClock(uint32_t stepMicros = 1000) : _now(0), _step(stepMicros) {}
+
+    uint32_t millis() { return _now / 1000; }
+    uint32_t micros() { return (uint32_t)_now; }
+    void delay(uint32_t ms) { _now += (uint64_t)ms * 1000; }
+    void idle() { _now += _step; }
+
+    void advance(uint32_t us) { _now += us; }
+    void setStep(uint32_t us) { _step = us; }
+
+private:
+    uint64_t _now;              // us
+    uint32_t _step;             // us
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+#include <string.h>
+
+#include "SIMCOM_CommandEngine.h"
+#include "SIMCOM_Reply.h"
+
+static bool startsWith(const char * line, const char * prefix)
+{
+    return strncmp(line, prefix, strlen(prefix)) == 0;
+}
+
+SIMCOM_CommandEngine::SIMCOM_CommandEngine(Stream & stream, SIMCOM_Clock & clock) :
+    _stream(stream),
+    _clock(clock),
+    _state(IDLE),
+    _result(SIMCOM_REPLY_NONE),
+    _deadline(0),
+    _dataLength(0),
+    _dataCount(0),
+    _lineLength(0)
+{
+    memset(&_request, 0, sizeof(_request));
+    _info[0] = '\0';
+}
+
+void SIMCOM_CommandEngine::start(const SIMCOM_CommandRequest & request)
+{
+    // Whatever came in before is not a reply to this command
+    while (_stream.read() >= 0) {
+    }
+    _request = request;
+    _state = REPLY;
+    _result = SIMCOM_REPLY_NONE;
+    _dataLength = 0;
+    _dataCount = 0;
+    _lineLength = 0;
+    _info[0] = '\0';
+    _stream.print(_request.command);
+    _stream.print('\r');
+    _deadline = _clock.millis() + _request.timeout;
+}
+
+void SIMCOM_CommandEngine::finish(SIMCOM_ReplyResult result)
+{
+    _result = result;
+    _state = DONE;
+}
+
+bool SIMCOM_CommandEngine::poll()
+{
+    if (!isBusy()) {
+        return _state == DONE;
+    }
+    int c;
+    while ((c = _stream.read()) >= 0) {
+        if (_state == DATA) {
+            if (_dataCount < _request.dataSize) {
+                _request.data[_dataCount] = c;
+            }
+            if (++_dataCount >= _dataLength) {
+                _state = REPLY;
+            }
+            continue;
+        }
+        if (c == '\r') {
+            continue;
+        }
+        if (c != '\n') {
+            if (_lineLength < sizeof(_line) - 1) {
+                _line[_lineLength++] = c;
+            }
+            continue;
+        }
+        _line[_lineLength] = '\0';
+        if (_lineLength > 0) {
+            _lineLength = 0;
+            handleLine();
+            if (_state == DONE) {
+                return true;
+            }
+        }
+    }
+    if ((int32_t)(_clock.millis() - _deadline) >= 0) {
+        finish(SIMCOM_REPLY_TIMEOUT);
+        return true;
+    }
+    return false;
+}
+
+void SIMCOM_CommandEngine::handleLine()
+{
+    if (_state == URC) {
+        if (startsWith(_line, _request.urc)) {
+            strcpy(_info, _line);
+            finish(SIMCOM_REPLY_OK);
+        }
+        return;
+    }
+    if (strcmp(_line, "OK") == 0) {
+        if (_request.urc) {
+            _state = URC;
+            _deadline = _clock.millis() + _request.timeout;
+        } else {
+            finish(SIMCOM_REPLY_OK);
+        }
+        return;
+    }
+    if (strcmp(_line, "ERROR") == 0 || startsWith(_line, "+CME ERROR:") || startsWith(_line, "+CMS ERROR:")) {
+        strcpy(_info, _line);
+        finish(SIMCOM_REPLY_ERROR);
+        return;
+    }
+    if (strcmp(_line, _request.command) == 0) {
+        // The echo
+        return;
+    }
+    strcpy(_info, _line);
+    if (_request.dataPrefix && startsWith(_line, _request.dataPrefix)) {
+        long length = 0;
+        SIMCOM_ReplyParser parser(_line + strlen(_request.dataPrefix));
+        if (parser.nextInt(length) && length > 0) {
+            _dataLength = length;
+            _state = DATA;
+        }
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_COMMANDENGINE_h
+#define _SIMCOM_COMMANDENGINE_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Stream.h>
+#include "SIMCOM_Clock.h"
+#include "SIMCOM_Commands.h"
+
+#define SIMCOM_ENGINE_LINE_SIZE         128
+
+/*!
+ * \brief What to send, and what reply to wait for
+ */
+struct SIMCOM_CommandRequest {
+    const char * command;       // without the CR
+    uint32_t timeout;           // ms, for the reply and again for the URC
+    // Optional: after OK wait for a line with this prefix, e.g. "+HTTPACTION:"
+    const char * urc;
+    // Optional: a line with this prefix gives the length of the binary
+    // data that follows, e.g. "+HTTPREAD:". At most dataSize bytes are
+    // stored.
+    const char * dataPrefix;
+    uint8_t * data;
+    size_t dataSize;
+};
+
+/*!
+ * \brief Sends one command and collects its reply without blocking
+ *
+ * start() sends the command, poll() reads what is there and returns
+ * true when the command is done. This is what the blocking methods of
+ * SIMx00 do in a loop, split up so that one thread can drive many
+ * modems.
+ */
+class SIMCOM_CommandEngine {
+public:
+    SIMCOM_CommandEngine(Stream & stream, SIMCOM_Clock & clock = SIMCOM_arduinoClock);
+
+    void start(const SIMCOM_CommandRequest & request);
+    // Read the available input. Returns true if the command is done.
+    bool poll();
+
+    bool isBusy() const { return _state != IDLE && _state != DONE; }
+    SIMCOM_ReplyResult result() const { return _result; }
+    // The last line of the reply that was not OK or the echo. For an
+    // error this is the error line, with a URC it is the URC.
+    const char * info() const { return _info; }
+    // The length of the binary data that the modem announced
+    size_t dataLength() const { return _dataLength; }
+    // The millis() at which the current wait times out
+    uint32_t deadline() const { return _deadline; }
+
+    Stream & stream() { return _stream; }
+    SIMCOM_Clock & clock() { return _clock; }
+
+private:
+    enum State {
+        IDLE,
+        REPLY,                  // waiting for OK or ERROR
+        DATA,                   // reading binary data
+        URC,                    // waiting for the URC after OK
+        DONE,
+    };
+    void handleLine();
+    void finish(SIMCOM_ReplyResult result);
+
+    Stream & _stream;
+    SIMCOM_Clock & _clock;
+    SIMCOM_CommandRequest _request;
+    State _state;
+    SIMCOM_ReplyResult _result;
+    uint32_t _deadline;
+    size_t _dataLength;
+    size_t _dataCount;
+    size_t _lineLength;
+    char _line[SIMCOM_ENGINE_LINE_SIZE];
+    char _info[SIMCOM_ENGINE_LINE_SIZE];
+};
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#include "SIMCOM_Commands.h"
+
+#define CMD_NAME_SIZE   11
+
+// The names, in the same order as SIMCOM_CommandId
+static const char commandNames[SIMCOM_CMD_NR][CMD_NAME_SIZE] PROGMEM = {
+    "OTHER",
+    "AT",
+    "ATE",
+    "ATI",
+    "CMEE",
+    "CSQ",
+    "CREG",
+    "CGATT",
+    "CSTT",
+    "CIICR",
+    "CIPSHUT",
+    "CIPMODE",
+    "CIPSTART",
+    "CIPSEND",
+    "CIPSTATUS",
+    "SAPBR",
+    "HTTPINIT",
+    "HTTPPARA",
+    "HTTPSSL",
+    "HTTPDATA",
+    "HTTPACTION",
+    "HTTPREAD",
+    "HTTPTERM",
+    "FTP",
+    "CMGF",
+    "CMGS",
+    "CCLK",
+    "CFUN",
+};
+
+/*
+ * \brief Find the family of an AT+ name
+ *
+ * The name ends at '=', '?', ':' or the end of the string.
+ */
+static uint8_t lookupName(const char * cmd)
+{
+    size_t len = 0;
+    while (cmd[len] != '\0' && cmd[len] != '=' && cmd[len] != '?' && cmd[len] != ':') {
+        ++len;
+    }
+    if (len >= 3 && strncmp_P(cmd, PSTR("FTP"), 3) == 0) {
+        return SIMCOM_CMD_FTP;
+    }
+    for (uint8_t id = SIMCOM_CMD_CMEE; id < SIMCOM_CMD_NR; ++id) {
+        if (id == SIMCOM_CMD_FTP) {
+            continue;
+        }
+        const char * name = commandNames[id];
+        if (strlen_P(name) == len && strncmp_P(cmd, name, len) == 0) {
+            return id;
+        }
+    }
+    return SIMCOM_CMD_OTHER;
+}
+
+uint8_t SIMCOM_classifyCommand(const char * cmd)
+{
+    if (cmd[0] != 'A' || cmd[1] != 'T') {
+        return SIMCOM_CMD_OTHER;
+    }
+    cmd += 2;
+    switch (*cmd) {
+    case '\0':
+        return SIMCOM_CMD_AT;
+    case 'E':
+        return SIMCOM_CMD_ATE;
+    case 'I':
+        return SIMCOM_CMD_ATI;
+    case '+':
+        break;
+    default:
+        return SIMCOM_CMD_OTHER;
+    }
+    return lookupName(cmd + 1);
+}
+
+uint8_t SIMCOM_classifyReply(const char * line)
+{
+    if (line[0] != '+') {
+        return SIMCOM_CMD_OTHER;
+    }
+    return lookupName(line + 1);
+}
+
+const char * SIMCOM_commandName(uint8_t id)
+{
+    if (id >= SIMCOM_CMD_NR) {
+        id = SIMCOM_CMD_OTHER;
+    }
+    return commandNames[id];
+}
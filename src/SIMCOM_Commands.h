@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_COMMANDS_h
+#define _SIMCOM_COMMANDS_h
+
+#include <stdint.h>
+
+/*!
+ * \brief The AT command families that the library knows about
+ *
+ * Used to keep statistics per command. Commands that are not
+ * in this list are counted as SIMCOM_CMD_OTHER.
+ */
+enum SIMCOM_CommandId {
+    SIMCOM_CMD_OTHER,
+    SIMCOM_CMD_AT,
+    SIMCOM_CMD_ATE,
+    SIMCOM_CMD_ATI,
+    // The following are AT+<name>, in the same order as the names in SIMCOM_Commands.cpp
+    SIMCOM_CMD_CMEE,
+    SIMCOM_CMD_CSQ,
+    SIMCOM_CMD_CREG,
+    SIMCOM_CMD_CGATT,
+    SIMCOM_CMD_CSTT,
+    SIMCOM_CMD_CIICR,
+    SIMCOM_CMD_CIPSHUT,
+    SIMCOM_CMD_CIPMODE,
+    SIMCOM_CMD_CIPSTART,
+    SIMCOM_CMD_CIPSEND,
+    SIMCOM_CMD_CIPSTATUS,
+    SIMCOM_CMD_SAPBR,
+    SIMCOM_CMD_HTTPINIT,
+    SIMCOM_CMD_HTTPPARA,
+    SIMCOM_CMD_HTTPSSL,
+    SIMCOM_CMD_HTTPDATA,
+    SIMCOM_CMD_HTTPACTION,
+    SIMCOM_CMD_HTTPREAD,
+    SIMCOM_CMD_HTTPTERM,
+    SIMCOM_CMD_FTP,             // all AT+FTP... commands
+    SIMCOM_CMD_CMGF,
+    SIMCOM_CMD_CMGS,
+    SIMCOM_CMD_CCLK,
+    SIMCOM_CMD_CFUN,
+    SIMCOM_CMD_NR
+};
+
+/*!
+ * \brief How the wait for a reply of a command ended
+ */
+enum SIMCOM_ReplyResult {
+    SIMCOM_REPLY_NONE,
+    SIMCOM_REPLY_OK,            // the expected reply
+    SIMCOM_REPLY_ERROR,         // ERROR, +CME ERROR or +CMS ERROR
+    SIMCOM_REPLY_TIMEOUT,
+};
+
+// Returns the family of the command (in RAM), e.g. "AT+CSQ" gives SIMCOM_CMD_CSQ
+uint8_t SIMCOM_classifyCommand(const char * cmd);
+
+// Returns the family of the prefix of a reply, e.g. "+CREG: 1" gives SIMCOM_CMD_CREG
+uint8_t SIMCOM_classifyReply(const char * line);
+
+// Returns the name of the family (in PROGMEM), e.g. "CSQ"
+const char * SIMCOM_commandName(uint8_t id);
+
+#endif
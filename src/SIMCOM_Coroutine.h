@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_COROUTINE_h
+#define _SIMCOM_COROUTINE_h
+
+/*
+ * An awaitable interface to the modem, for host builds with C++20:
+ *
+ *   SIMCOM_Task<void> report(SIMCOM_CoModem & modem)
+ *   {
+ *       SIMCOM_CoReply reply = co_await modem.command("AT+CSQ");
+ *       char body[256];
+ *       int status = co_await modem.httpGet("http://example.com/", body, sizeof(body));
+ *   }
+ *
+ *   SIMCOM_CoScheduler scheduler;
+ *   SIMCOM_CoModem modem1(scheduler, serial1), modem2(scheduler, serial2);
+ *   modem1.setPollFd(serial1.fd());
+ *   modem2.setPollFd(serial2.fd());
+ *   scheduler.spawn(report(modem1));
+ *   scheduler.spawn(report(modem2));
+ *   scheduler.run();
+ *
+ * All the modems are driven from the thread that calls run(). The
+ * blocking SIMx00 methods remain for sketches.
+ */
+
+#if !defined(ARDUINO) && defined(__has_include)
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#define SIMCOM_HAS_COROUTINES   1
+#endif
+#endif
+
+#ifdef SIMCOM_HAS_COROUTINES
+
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+#include "SIMCOM_CommandEngine.h"
+#include "SIMCOM_Reply.h"
+
+/*!
+ * \brief A coroutine that gives a T when it is done
+ *
+ * It starts when it is awaited, or when it is given to the scheduler.
+ */
+template <typename T>
+class SIMCOM_Task;
+
+namespace SIMCOM_detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+        {
+            std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); }
+};
+
+} // namespace SIMCOM_detail
+
+template <typename T>
+class SIMCOM_Task {
+public:
+    struct promise_type : SIMCOM_detail::PromiseBase {
+        T value;
+        SIMCOM_Task get_return_object() { return SIMCOM_Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_value(T v) { value = std::move(v); }
+    };
+
+    SIMCOM_Task(SIMCOM_Task && other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+    ~SIMCOM_Task() { if (_handle) { _handle.destroy(); } }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+    {
+        _handle.promise().continuation = caller;
+        return _handle;
+    }
+    T await_resume() { return std::move(_handle.promise().value); }
+
+private:
+    explicit SIMCOM_Task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+    std::coroutine_handle<promise_type> _handle;
+    friend class SIMCOM_CoScheduler;
+};
+
+template <>
+class SIMCOM_Task<void> {
+public:
+    struct promise_type : SIMCOM_detail::PromiseBase {
+        SIMCOM_Task get_return_object() { return SIMCOM_Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_void() {}
+    };
+
+    SIMCOM_Task(SIMCOM_Task && other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+    ~SIMCOM_Task() { if (_handle) { _handle.destroy(); } }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+    {
+        _handle.promise().continuation = caller;
+        return _handle;
+    }
+    void await_resume() {}
+
+private:
+    explicit SIMCOM_Task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+    std::coroutine_handle<promise_type> _handle;
+    friend class SIMCOM_CoScheduler;
+};
+
+/*!
+ * \brief The reply of a command
+ */
+struct SIMCOM_CoReply {
+    SIMCOM_ReplyResult result;
+    const char * info;          // see SIMCOM_CommandEngine::info(), valid until the next command
+    bool ok() const { return result == SIMCOM_REPLY_OK; }
+};
+
+class SIMCOM_CoModem;
+
+/*!
+ * \brief Runs the tasks and polls the modems, all on one thread
+ */
+class SIMCOM_CoScheduler {
+public:
+    SIMCOM_CoScheduler() : _modems(0) {}
+    ~SIMCOM_CoScheduler()
+    {
+        for (size_t i = 0; i < _tasks.size(); ++i) {
+            _tasks[i].destroy();
+        }
+    }
+
+    // Start a task. The scheduler owns it from now on.
+    void spawn(SIMCOM_Task<void> && task)
+    {
+        std::coroutine_handle<SIMCOM_Task<void>::promise_type> handle = std::exchange(task._handle, nullptr);
+        _tasks.push_back(handle);
+        handle.resume();
+    }
+
+    // Poll all the modems once, resume the tasks whose command is done.
+    // Returns the number of tasks that are not done.
+    size_t poll();
+
+    // Wait until a modem has input, or the first command times out.
+    // This only blocks if all waiting modems have a poll fd, see
+    // SIMCOM_CoModem::setPollFd(). The clock must then be real time.
+    void wait(SIMCOM_Clock & clock = SIMCOM_arduinoClock);
+
+    // Poll until all tasks are done
+    void run(SIMCOM_Clock & clock = SIMCOM_arduinoClock)
+    {
+        while (poll() > 0) {
+            wait(clock);
+        }
+    }
+
+private:
+    friend class SIMCOM_CoModem;
+    std::vector<struct pollfd> _fds;
+    SIMCOM_CoModem * _modems;
+    std::vector<std::coroutine_handle<SIMCOM_Task<void>::promise_type> > _tasks;
+};
+
+/*!
+ * \brief A modem that is driven by coroutines
+ *
+ * Only one task at a time may use a modem. The modem must exist as
+ * long as the scheduler.
+ */
+class SIMCOM_CoModem {
+public:
+    SIMCOM_CoModem(SIMCOM_CoScheduler & scheduler, Stream & stream, SIMCOM_Clock & clock = SIMCOM_arduinoClock) :
+        _engine(stream, clock),
+        _waiting(nullptr),
+        _pollFd(-1),
+        _isEvent(false),
+        _next(scheduler._modems)
+    {
+        scheduler._modems = this;
+    }
+
+    // The file descriptor that is readable when the stream has input,
+    // e.g. SIMCOM_PosixSerial::fd(). For SIMCOM_ThreadedSerial::eventFd()
+    // set isEvent, the scheduler then empties it before polling.
+    void setPollFd(int fd, bool isEvent = false) { _pollFd = fd; _isEvent = isEvent; }
+
+    struct CommandAwaiter {
+        SIMCOM_CoModem & modem;
+        SIMCOM_CommandRequest request;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> caller)
+        {
+            modem._engine.start(request);
+            modem._waiting = caller;
+        }
+        SIMCOM_CoReply await_resume() const
+        {
+            SIMCOM_CoReply reply = { modem._engine.result(), modem._engine.info() };
+            return reply;
+        }
+    };
+
+    // Send a command (in RAM) and wait for OK, ERROR or the timeout
+    CommandAwaiter command(const char * cmd, uint32_t timeout = 4000)
+    {
+        return CommandAwaiter{ *this, { cmd, timeout, 0, 0, 0, 0 } };
+    }
+    // Send a command, and after OK wait for a line with the urc prefix
+    CommandAwaiter commandWithUrc(const char * cmd, const char * urc, uint32_t timeout)
+    {
+        return CommandAwaiter{ *this, { cmd, timeout, urc, 0, 0, 0 } };
+    }
+    CommandAwaiter commandWithData(const char * cmd, const char * dataPrefix, uint8_t * data, size_t size, uint32_t timeout = 8000)
+    {
+        return CommandAwaiter{ *this, { cmd, timeout, 0, dataPrefix, data, size } };
+    }
+
+    /*
+     * HTTP GET with an open bearer (AT+SAPBR=1,1). The body
+     * is stored in buffer and terminated. Returns the HTTP status, or
+     * -1 if a command failed.
+     */
+    SIMCOM_Task<int> httpGet(const char * url, char * buffer, size_t size)
+    {
+        char cmd[SIMCOM_ENGINE_LINE_SIZE];
+        int status = -1;
+        int length = 0;
+        SIMCOM_CoReply reply;
+
+        // A URL that doesn't fit the command line is not sent cut short
+        int len = snprintf(cmd, sizeof(cmd), "AT+HTTPPARA=\"URL\",\"%s\"", url);
+        if (len < 0 || (size_t)len >= sizeof(cmd)) {
+            co_return -1;
+        }
+        co_await command("AT+HTTPTERM");        // ignore the result
+        if (!(co_await command("AT+HTTPINIT")).ok() ||
+                !(co_await command("AT+HTTPPARA=\"CID\",1")).ok()) {
+            co_return -1;
+        }
+        if (!(co_await command(cmd)).ok()) {
+            co_return -1;
+        }
+        reply = co_await commandWithUrc("AT+HTTPACTION=0", "+HTTPACTION:", 20000);
+        if (!reply.ok() ||
+                SIMCOM_scanReply(reply.info, PSTR("+HTTPACTION: %*,%d,%d"), &status, &length) < 1) {
+            co_return -1;
+        }
+        if (size > 0) {
+            buffer[0] = '\0';
+        }
+        if (length > 0 && size > 0) {
+            reply = co_await commandWithData("AT+HTTPREAD", "+HTTPREAD:", (uint8_t *)buffer, size - 1);
+            if (reply.ok()) {
+                size_t nr = _engine.dataLength();
+                buffer[nr < size - 1 ? nr : size - 1] = '\0';
+            }
+        }
+        co_await command("AT+HTTPTERM");
+        co_return status;
+    }
+
+private:
+    friend class SIMCOM_CoScheduler;
+    SIMCOM_CommandEngine _engine;
+    std::coroutine_handle<> _waiting;
+    int _pollFd;
+    bool _isEvent;
+    SIMCOM_CoModem * _next;
+};
+
+inline size_t SIMCOM_CoScheduler::poll()
+{
+    for (SIMCOM_CoModem * modem = _modems; modem; modem = modem->_next) {
+        if (modem->_waiting && modem->_engine.poll()) {
+            std::exchange(modem->_waiting, nullptr).resume();
+        }
+    }
+    size_t alive = 0;
+    for (size_t i = 0; i < _tasks.size(); ) {
+        if (_tasks[i].done()) {
+            _tasks[i].destroy();
+            _tasks[i] = _tasks.back();
+            _tasks.pop_back();
+        } else {
+            ++alive;
+            ++i;
+        }
+    }
+    return alive;
+}
+
+inline void SIMCOM_CoScheduler::wait(SIMCOM_Clock & clock)
+{
+    uint32_t now = clock.millis();
+    int32_t timeout = -1;
+    _fds.clear();
+    for (SIMCOM_CoModem * modem = _modems; modem; modem = modem->_next) {
+        if (!modem->_waiting) {
+            continue;
+        }
+        if (modem->_pollFd < 0) {
+            // Can't block on this one, poll it again
+            _fds.clear();
+            timeout = 0;
+            break;
+        }
+        int32_t left = (int32_t)(modem->_engine.deadline() - now);
+        if (left < 0) {
+            left = 0;
+        }
+        if (timeout < 0 || left < timeout) {
+            timeout = left;
+        }
+        struct pollfd pfd = { modem->_pollFd, POLLIN, 0 };
+        _fds.push_back(pfd);
+    }
+    if (!_fds.empty() && ::poll(&_fds[0], _fds.size(), timeout) > 0) {
+        // The fds are in the order of the waiting modems
+        size_t ix = 0;
+        for (SIMCOM_CoModem * modem = _modems; modem; modem = modem->_next) {
+            if (!modem->_waiting) {
+                continue;
+            }
+            if (modem->_isEvent && (_fds[ix].revents & POLLIN)) {
+                char buf[64];
+                while (::read(modem->_pollFd, buf, sizeof(buf)) > 0) {
+                }
+            }
+            ++ix;
+        }
+    }
+    clock.idle();
+}
+
+#endif
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#include "SIMCOM_Encoder.h"
+
+// CBOR major types
+#define CBOR_UINT       0
+#define CBOR_NEGINT     1
+#define CBOR_BYTES      2
+#define CBOR_TEXT       3
+#define CBOR_ARRAY      4
+#define CBOR_MAP        5
+#define CBOR_SIMPLE     7
+
+#define CBOR_FALSE      20
+#define CBOR_TRUE       21
+#define CBOR_NULL       22
+#define CBOR_FLOAT32    26
+
+size_t SIMCOM_Varint::size(uint32_t value)
+{
+    size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+size_t SIMCOM_Varint::write(Print * out, uint32_t value)
+{
+    size_t n = 1;
+    while (value >= 0x80) {
+        if (out) {
+            out->write((uint8_t)(value | 0x80));
+        }
+        value >>= 7;
+        ++n;
+    }
+    if (out) {
+        out->write((uint8_t)value);
+    }
+    return n;
+}
+
+size_t SIMCOM_Varint::deltaSeriesSize(const int32_t * values, size_t nr)
+{
+    return writeDeltaSeries(NULL, values, nr);
+}
+
+size_t SIMCOM_Varint::writeDeltaSeries(Print * out, const int32_t * values, size_t nr)
+{
+    size_t n = 0;
+    int32_t prev = 0;
+    for (size_t i = 0; i < nr; ++i) {
+        // The delta wraps, a signed subtraction could overflow
+        n += write(out, zigzag((int32_t)((uint32_t)values[i] - (uint32_t)prev)));
+        prev = values[i];
+    }
+    return n;
+}
+
+void SIMCOM_CBORWriter::put(uint8_t value)
+{
+    if (_out) {
+        _out->write(value);
+    }
+    ++_length;
+}
+
+/*
+ * \brief Write the initial byte(s) of a data item
+ *
+ * The argument is stored in the smallest possible encoding.
+ */
+void SIMCOM_CBORWriter::writeHead(uint8_t major, uint32_t value)
+{
+    major <<= 5;
+    if (value < 24) {
+        put(major | value);
+    } else if (value <= 0xFF) {
+        put(major | 24);
+        put(value);
+    } else if (value <= 0xFFFF) {
+        put(major | 25);
+        put(value >> 8);
+        put(value);
+    } else {
+        put(major | 26);
+        put(value >> 24);
+        put(value >> 16);
+        put(value >> 8);
+        put(value);
+    }
+}
+
+void SIMCOM_CBORWriter::writeUInt(uint32_t value)
+{
+    writeHead(CBOR_UINT, value);
+}
+
+void SIMCOM_CBORWriter::writeInt(int32_t value)
+{
+    if (value < 0) {
+        // Negative integers are encoded as -1 - n
+        writeHead(CBOR_NEGINT, (uint32_t)(-1 - value));
+    } else {
+        writeHead(CBOR_UINT, value);
+    }
+}
+
+void SIMCOM_CBORWriter::writeBool(bool value)
+{
+    put((CBOR_SIMPLE << 5) | (value ? CBOR_TRUE : CBOR_FALSE));
+}
+
+void SIMCOM_CBORWriter::writeNull()
+{
+    put((CBOR_SIMPLE << 5) | CBOR_NULL);
+}
+
+void SIMCOM_CBORWriter::writeFloat(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put((CBOR_SIMPLE << 5) | CBOR_FLOAT32);
+    put(bits >> 24);
+    put(bits >> 16);
+    put(bits >> 8);
+    put(bits);
+}
+
+void SIMCOM_CBORWriter::writeText(const char * str)
+{
+    size_t len = strlen(str);
+    writeHead(CBOR_TEXT, len);
+    for (size_t i = 0; i < len; ++i) {
+        put(str[i]);
+    }
+}
+
+void SIMCOM_CBORWriter::writeText_P(const char * str)
+{
+    size_t len = strlen_P(str);
+    writeHead(CBOR_TEXT, len);
+    for (size_t i = 0; i < len; ++i) {
+        put(pgm_read_byte(str + i));
+    }
+}
+
+void SIMCOM_CBORWriter::writeBytes(const uint8_t * data, size_t len)
+{
+    writeHead(CBOR_BYTES, len);
+    for (size_t i = 0; i < len; ++i) {
+        put(data[i]);
+    }
+}
+
+void SIMCOM_CBORWriter::beginArray(size_t nr)
+{
+    writeHead(CBOR_ARRAY, nr);
+}
+
+void SIMCOM_CBORWriter::beginMap(size_t nr)
+{
+    writeHead(CBOR_MAP, nr);
+}
+
+void SIMCOM_CBORWriter::writeDeltaSeries(const int32_t * values, size_t nr)
+{
+    // A byte string needs its length up front
+    writeHead(CBOR_BYTES, SIMCOM_Varint::deltaSeriesSize(values, nr));
+    _length += SIMCOM_Varint::writeDeltaSeries(_out, values, nr);
+}
+
+void SIMCOM_CBORBody::render(Print & out)
+{
+    SIMCOM_CBORWriter writer(&out);
+    _encoder.encode(writer);
+}
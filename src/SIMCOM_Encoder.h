@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_ENCODER_h
+#define _SIMCOM_ENCODER_h
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <Print.h>
+#include "SIMCOM_Body.h"
+
+/*!
+ * \brief Compact binary encoders for telemetry payloads
+ *
+ * The encoders write directly to a Print (e.g. the modem stream), so
+ * there is no need to build the payload in RAM first. When the Print
+ * is NULL nothing is written, only the length is computed.
+ * See also SIMCOM_BodyProducer.
+ */
+
+/*!
+ * \brief Zigzag / varint (LEB128) helpers
+ */
+class SIMCOM_Varint {
+public:
+    // Map a signed value onto an unsigned one, small magnitudes stay small.
+    static uint32_t zigzag(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+
+    // Returns the number of bytes needed to encode the value as varint.
+    static size_t size(uint32_t value);
+
+    // Write the value as varint. Returns the number of bytes.
+    static size_t write(Print * out, uint32_t value);
+
+    // Returns the number of bytes needed for a delta encoded series.
+    static size_t deltaSeriesSize(const int32_t * values, size_t nr);
+
+    // Write the values as zigzag varints of the difference with the
+    // previous value. The first value is relative to zero.
+    static size_t writeDeltaSeries(Print * out, const int32_t * values, size_t nr);
+};
+
+/*!
+ * \brief A streaming CBOR (RFC 7049) writer
+ *
+ * Only definite length items are supported, because that gives
+ * the smallest encoding and the length of arrays and maps is known
+ * by the caller anyway.
+ */
+class SIMCOM_CBORWriter {
+public:
+    // When out is NULL only the length is computed.
+    SIMCOM_CBORWriter(Print * out = NULL) : _out(out), _length(0) {}
+
+    // Returns the number of bytes written (or that would have been written).
+    size_t length() const { return _length; }
+
+    void writeUInt(uint32_t value);
+    void writeInt(int32_t value);
+    void writeBool(bool value);
+    void writeNull();
+    void writeFloat(float value);
+    void writeText(const char * str);
+    void writeText_P(const char * str);
+    void writeBytes(const uint8_t * data, size_t len);
+
+    // Start an array/map with nr items. The items must follow.
+    // For a map each item is a key and value pair.
+    void beginArray(size_t nr);
+    void beginMap(size_t nr);
+
+    // Write a time series as a byte string with delta-plus-varint encoded values
+    void writeDeltaSeries(const int32_t * values, size_t nr);
+
+private:
+    void writeHead(uint8_t major, uint32_t value);
+    void put(uint8_t value);
+
+    Print * _out;
+    size_t _length;
+};
+
+/*!
+ * \brief The application implements this to produce a CBOR body
+ *
+ * encode() is called twice, first to compute the length, then to send
+ * the bytes. It must produce exactly the same sequence both times.
+ */
+class SIMCOM_TelemetryEncoder {
+public:
+    virtual ~SIMCOM_TelemetryEncoder() {}
+    virtual void encode(SIMCOM_CBORWriter & writer) = 0;
+};
+
+/*!
+ * \brief Adapter to use a telemetry encoder as a request body
+ */
+class SIMCOM_CBORBody : public SIMCOM_BodyProducer {
+public:
+    SIMCOM_CBORBody(SIMCOM_TelemetryEncoder & encoder) : _encoder(encoder) {}
+    void render(Print & out);
+
+private:
+    SIMCOM_TelemetryEncoder & _encoder;
+};
+
+#endif
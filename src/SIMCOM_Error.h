@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_ERROR_h
+#define _SIMCOM_ERROR_h
+
+#include <stdint.h>
+
+// The number of characters of the failing command that are kept
+#define SIMCOM_ERROR_CMD_SIZE   20
+
+/*!
+ * \brief The kind of failure of the last command
+ *
+ * This is what the retry logic uses to decide.
+ */
+enum SIMCOM_ErrorClass {
+    SIMCOM_ERR_NONE,
+    SIMCOM_ERR_TIMEOUT,         // no (complete) reply in time
+    SIMCOM_ERR_REPLY,           // the modem replied with an error
+    SIMCOM_ERR_PERMANENT,       // an error that a retry will not fix
+};
+
+/*!
+ * \brief Where the error came from
+ */
+enum SIMCOM_ErrorKind {
+    SIMCOM_ERRKIND_NONE,
+    SIMCOM_ERRKIND_TIMEOUT,     // no reply in time
+    SIMCOM_ERRKIND_ERROR,       // plain "ERROR"
+    SIMCOM_ERRKIND_CME,         // "+CME ERROR: <code>", equipment
+    SIMCOM_ERRKIND_CMS,         // "+CMS ERROR: <code>", SMS
+    SIMCOM_ERRKIND_HTTP,        // HTTPACTION status code, e.g. 404 or 603 (DNS error)
+    SIMCOM_ERRKIND_ARGUMENT,    // an argument that can't be sent, e.g. a '"' in a quoted string
+};
+
+/*!
+ * \brief The details of the last failed command
+ *
+ * Notice that with AT+CMEE=2 the modem replies with text. The library
+ * maps the known texts back onto the numeric (3GPP TS 27.007) code,
+ * unknown texts get code 100 ("unknown").
+ */
+struct SIMCOM_Error {
+    SIMCOM_ErrorClass errorClass;
+    SIMCOM_ErrorKind kind;
+    uint16_t code;              // CME, CMS or HTTP code, else 0
+    uint32_t elapsed;           // ms from sending the command until the failure
+    char command[SIMCOM_ERROR_CMD_SIZE];    // the start of the failing command
+};
+
+#endif
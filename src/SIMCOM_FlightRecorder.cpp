@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include <string.h>
+
+#include "SIMCOM_FlightRecorder.h"
+
+/*
+ * An entry is:
+ *   <kind> <cmd> <delta> <len> <text>
+ * <kind> bits 7..6 are the kind of entry, bit 0 is set if the prefix
+ * of the command family was stripped. <delta> is a varint with the
+ * milliseconds since the previous entry.
+ */
+#define KIND_COMMAND    0x00
+#define KIND_LINE       0x40
+#define KIND_TIMEOUT    0x80
+#define KIND_MASK       0xC0
+#define FLAG_STRIPPED   0x01
+
+SIMCOM_FlightRecorder::SIMCOM_FlightRecorder(uint8_t * buffer, size_t size) :
+    _buffer(buffer),
+    _size(size),
+    _paused(false)
+{
+    clear();
+}
+
+void SIMCOM_FlightRecorder::clear()
+{
+    _tail = 0;
+    _used = 0;
+    _last = 0;
+    _stagingLength = 0;
+}
+
+void SIMCOM_FlightRecorder::commandText(const char * text, bool progmem)
+{
+    while (_stagingLength < sizeof(_staging)) {
+        char c = progmem ? pgm_read_byte(text) : *text;
+        if (c == '\0') {
+            break;
+        }
+        _staging[_stagingLength++] = c;
+        ++text;
+    }
+}
+
+/*
+ * \brief Returns the length of the prefix that the command family implies
+ *
+ * For the reply lines this is "+<name>:", for commands "AT+<name>".
+ */
+static size_t prefixLength(uint8_t cmd, bool reply, const char * text, size_t len)
+{
+    if (cmd == SIMCOM_CMD_OTHER || cmd == SIMCOM_CMD_FTP || cmd >= SIMCOM_CMD_NR) {
+        // The name is not all of the prefix
+        return 0;
+    }
+    const char * name = SIMCOM_commandName(cmd);
+    size_t nameLen = strlen_P(name);
+    if (cmd < SIMCOM_CMD_CMEE) {
+        // AT, ATE and ATI
+        if (reply || len < nameLen || strncmp_P(text, name, nameLen) != 0) {
+            return 0;
+        }
+        return nameLen;
+    }
+    size_t start = reply ? 1 : 3;
+    if (len < start + nameLen + (reply ? 1 : 0)) {
+        return 0;
+    }
+    if (strncmp_P(text, reply ? PSTR("+") : PSTR("AT+"), start) != 0 ||
+            strncmp_P(text + start, name, nameLen) != 0) {
+        return 0;
+    }
+    if (reply) {
+        return text[start + nameLen] == ':' ? start + nameLen + 1 : 0;
+    }
+    return start + nameLen;
+}
+
+void SIMCOM_FlightRecorder::commandSent(uint8_t cmd, uint32_t now)
+{
+    if (!_paused) {
+        size_t skip = prefixLength(cmd, false, _staging, _stagingLength);
+        add(KIND_COMMAND | (skip ? FLAG_STRIPPED : 0), cmd, now, _staging + skip, _stagingLength - skip);
+    }
+    _stagingLength = 0;
+}
+
+void SIMCOM_FlightRecorder::line(const char * text, uint8_t cmd, uint32_t now)
+{
+    if (_paused) {
+        return;
+    }
+    size_t len = strlen(text);
+    size_t skip = prefixLength(cmd, true, text, len);
+    add(KIND_LINE | (skip ? FLAG_STRIPPED : 0), cmd, now, text + skip, len - skip);
+}
+
+void SIMCOM_FlightRecorder::timeout(uint8_t cmd, uint32_t now)
+{
+    if (!_paused) {
+        add(KIND_TIMEOUT, cmd, now, NULL, 0);
+    }
+}
+
+void SIMCOM_FlightRecorder::put(uint8_t b)
+{
+    _buffer[(_tail + _used) % _size] = b;
+    ++_used;
+}
+
+size_t SIMCOM_FlightRecorder::entrySize(size_t offset) const
+{
+    size_t size = 2;
+    while (at(offset + size++) & 0x80) {
+        // The varint
+    }
+    return size + 1 + at(offset + size);
+}
+
+void SIMCOM_FlightRecorder::add(uint8_t kind, uint8_t cmd, uint32_t now, const char * text, size_t len)
+{
+    if (len > SIMCOM_FLIGHT_LINE_MAX) {
+        len = SIMCOM_FLIGHT_LINE_MAX;
+    }
+    uint32_t delta = _used > 0 ? now - _last : 0;
+    size_t need = 2 + 1 + len;
+    for (uint32_t v = delta; v >= 0x80; v >>= 7) {
+        ++need;
+    }
+    ++need;
+    if (need > _size) {
+        return;
+    }
+    // Make room, drop the oldest entries
+    while (_size - _used < need) {
+        size_t size = entrySize(0);
+        _tail = (_tail + size) % _size;
+        _used -= size;
+    }
+
+    put(kind);
+    put(cmd);
+    while (delta >= 0x80) {
+        put((delta & 0x7F) | 0x80);
+        delta >>= 7;
+    }
+    put(delta);
+    put(len);
+    for (size_t i = 0; i < len; ++i) {
+        put(text[i]);
+    }
+    _last = now;
+}
+
+void SIMCOM_FlightRecorder::dump(Print & out) const
+{
+    size_t offset = 0;
+    while (offset < _used) {
+        uint8_t kind = at(offset);
+        uint8_t cmd = at(offset + 1);
+        size_t pos = offset + 2;
+        uint32_t delta = 0;
+        uint8_t shift = 0;
+        uint8_t b;
+        do {
+            b = at(pos++);
+            delta |= (uint32_t)(b & 0x7F) << shift;
+            shift += 7;
+        } while (b & 0x80);
+        uint8_t len = at(pos++);
+
+        out.print('+');
+        out.print(delta);
+        switch (kind & KIND_MASK) {
+        case KIND_COMMAND:
+            out.print(F(" > "));
+            if (kind & FLAG_STRIPPED) {
+                if (cmd >= SIMCOM_CMD_CMEE) {
+                    out.print(F("AT+"));
+                }
+                out.print(reinterpret_cast<const __FlashStringHelper *>(SIMCOM_commandName(cmd)));
+            }
+            break;
+        case KIND_LINE:
+            out.print(F(" < "));
+            if (kind & FLAG_STRIPPED) {
+                out.print('+');
+                out.print(reinterpret_cast<const __FlashStringHelper *>(SIMCOM_commandName(cmd)));
+                out.print(':');
+            }
+            break;
+        default:
+            out.print(F(" timeout "));
+            out.print(reinterpret_cast<const __FlashStringHelper *>(SIMCOM_commandName(cmd)));
+            break;
+        }
+        for (uint8_t i = 0; i < len; ++i) {
+            out.print((char)at(pos + i));
+        }
+        out.println();
+        offset = pos + len;
+    }
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_FLIGHTRECORDER_h
+#define _SIMCOM_FLIGHTRECORDER_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Print.h>
+#include "SIMCOM_Body.h"
+#include "SIMCOM_Commands.h"
+
+// The part of a command or reply line that is kept
+#define SIMCOM_FLIGHT_LINE_MAX          48
+
+/*!
+ * \brief The last commands and replies, to find out what went wrong
+ *
+ * Each entry is the command family (see SIMCOM_Commands.h), the time
+ * since the previous entry and the rest of the text. For example
+ * AT+CSQ is kept as the CSQ family without text, and "+CSQ: 18,0"
+ * as a reply of the CSQ family with " 18,0". When the ring is full
+ * the oldest entries are dropped.
+ */
+class SIMCOM_FlightRecorder {
+public:
+    SIMCOM_FlightRecorder(uint8_t * buffer, size_t size);
+
+    void clear();
+
+    // A part of the command that is being sent
+    void commandText(const char * text, bool progmem);
+    // The command was sent
+    void commandSent(uint8_t cmd, uint32_t now);
+    // A line was received while <cmd> was the current command
+    void line(const char * text, uint8_t cmd, uint32_t now);
+    // No reply in time
+    void timeout(uint8_t cmd, uint32_t now);
+
+    // The number of bytes in use
+    size_t used() const { return _used; }
+
+    // Nothing is recorded while paused, e.g. while uploading the dump
+    void pause(bool paused) { _paused = paused; }
+
+    // Write the entries as text, one line each, oldest first. For example
+    //   +120 > AT+CSQ
+    //   +95 < +CSQ: 18,0
+    void dump(Print & out) const;
+
+private:
+    void add(uint8_t kind, uint8_t cmd, uint32_t now, const char * text, size_t len);
+    void put(uint8_t b);
+    uint8_t at(size_t offset) const { return _buffer[(_tail + offset) % _size]; }
+    size_t entrySize(size_t offset) const;
+
+    uint8_t * _buffer;
+    size_t _size;
+    size_t _tail;               // the oldest entry
+    size_t _used;
+    uint32_t _last;             // the time of the last entry
+    bool _paused;
+    uint8_t _stagingLength;
+    char _staging[SIMCOM_FLIGHT_LINE_MAX];
+};
+
+/*!
+ * \brief A flight recorder with its own buffer
+ */
+template <size_t N>
+class SIMCOM_StaticFlightRecorder : public SIMCOM_FlightRecorder {
+public:
+    SIMCOM_StaticFlightRecorder() : SIMCOM_FlightRecorder(_data, N) {}
+private:
+    uint8_t _data[N];
+};
+
+/*!
+ * \brief The dump of a flight recorder as HTTP POST body
+ *
+ * E.g. to upload it with the next successful connection. The recorder
+ * is paused while this object exists, so that the commands of the
+ * upload itself don't change the length of the body.
+ */
+class SIMCOM_FlightRecorderBody : public SIMCOM_BodyProducer {
+public:
+    SIMCOM_FlightRecorderBody(SIMCOM_FlightRecorder & recorder) : _recorder(recorder) { _recorder.pause(true); }
+    ~SIMCOM_FlightRecorderBody() { _recorder.pause(false); }
+    void render(Print & out) { _recorder.dump(out); }
+private:
+    SIMCOM_FlightRecorder & _recorder;
+};
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "SIMCOM_Latency.h"
+
+SIMCOM_LatencyTable::SIMCOM_LatencyTable() :
+    _percentile(99),
+    _margin(50),
+    _minSamples(20)
+{
+    clear();
+}
+
+void SIMCOM_LatencyTable::clear()
+{
+    memset(_counts, 0, sizeof(_counts));
+}
+
+uint8_t SIMCOM_LatencyTable::bucketIndex(uint32_t ms)
+{
+    uint8_t ix = 0;
+    while (ix < SIMCOM_LATENCY_BUCKETS - 1 && ms >= bucketBound(ix)) {
+        ++ix;
+    }
+    return ix;
+}
+
+void SIMCOM_LatencyTable::record(uint8_t cmd, uint8_t phase, uint32_t ms)
+{
+    if (cmd >= SIMCOM_CMD_NR) {
+        cmd = SIMCOM_CMD_OTHER;
+    }
+    if (phase >= SIMCOM_LATENCY_PHASES) {
+        phase = SIMCOM_LATENCY_PHASES - 1;
+    }
+    uint8_t * counts = _counts[cmd][phase];
+    uint8_t ix = bucketIndex(ms);
+    if (counts[ix] == 0xFF) {
+        for (uint8_t i = 0; i < SIMCOM_LATENCY_BUCKETS; ++i) {
+            counts[i] /= 2;
+        }
+    }
+    ++counts[ix];
+}
+
+uint16_t SIMCOM_LatencyTable::samples(uint8_t cmd, uint8_t phase) const
+{
+    if (cmd >= SIMCOM_CMD_NR || phase >= SIMCOM_LATENCY_PHASES) {
+        return 0;
+    }
+    uint16_t total = 0;
+    for (uint8_t i = 0; i < SIMCOM_LATENCY_BUCKETS; ++i) {
+        total += _counts[cmd][phase][i];
+    }
+    return total;
+}
+
+uint32_t SIMCOM_LatencyTable::timeout(uint8_t cmd, uint8_t phase) const
+{
+    uint16_t total = samples(cmd, phase);
+    if (total == 0 || total < _minSamples) {
+        return 0;
+    }
+
+    // The number of samples that must be below the bound, rounded up
+    uint32_t needed = ((uint32_t)total * _percentile + 99) / 100;
+    uint32_t seen = 0;
+    uint8_t ix;
+    for (ix = 0; ix < SIMCOM_LATENCY_BUCKETS - 1; ++ix) {
+        seen += _counts[cmd][phase][ix];
+        if (seen >= needed) {
+            break;
+        }
+    }
+    if (ix == SIMCOM_LATENCY_BUCKETS - 1) {
+        // The percentile is in the open ended bucket, we know nothing
+        return 0;
+    }
+
+    uint32_t ms = bucketBound(ix);
+    ms += ms * _margin / 100;
+    if (ms < SIMCOM_LATENCY_MIN_TIMEOUT) {
+        ms = SIMCOM_LATENCY_MIN_TIMEOUT;
+    }
+    return ms;
+}
+
+bool SIMCOM_LatencyTable::load(const uint8_t * data, size_t size)
+{
+    if (size != sizeof(_counts)) {
+        return false;
+    }
+    memcpy(_counts, data, size);
+    return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_LATENCY_h
+#define _SIMCOM_LATENCY_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "SIMCOM_Commands.h"
+
+// Bucket i counts the replies that took less than 32 << i ms. The last
+// bucket also counts everything that took longer.
+#define SIMCOM_LATENCY_BUCKETS          12
+#define SIMCOM_LATENCY_FIRST_BOUND      32
+
+// Phase 0 is the first reply of a command (e.g. "OK" or "DOWNLOAD"),
+// phase 1 is everything after that (e.g. "+HTTPACTION:" or "SEND OK")
+#define SIMCOM_LATENCY_PHASES           2
+
+// A learned timeout is never shorter than this (ms)
+#define SIMCOM_LATENCY_MIN_TIMEOUT      500
+
+/*!
+ * \brief Reply times per command, used to learn the timeouts
+ *
+ * For each command family and phase it keeps a histogram of the
+ * time until the reply. The learned timeout is the bound of the
+ * bucket that holds the chosen percentile, plus a margin. Until
+ * there are enough samples there is no learned timeout.
+ *
+ * A timeout is recorded with the time that was waited. If the
+ * learned timeout turns out to be too short it will thus grow
+ * again. Counts are halved when one of them is full, so old
+ * samples slowly lose weight.
+ *
+ * The counts can be saved with data() and size(), for example
+ * in EEPROM, and restored with load().
+ */
+class SIMCOM_LatencyTable {
+public:
+    SIMCOM_LatencyTable();
+
+    void clear();
+
+    // Record a reply (or timeout) after <ms> milliseconds
+    void record(uint8_t cmd, uint8_t phase, uint32_t ms);
+
+    // Returns the learned timeout (ms), or 0 if not known yet
+    uint32_t timeout(uint8_t cmd, uint8_t phase) const;
+
+    // Returns the number of samples (after halving)
+    uint16_t samples(uint8_t cmd, uint8_t phase) const;
+
+    void setPercentile(uint8_t percentile) { _percentile = percentile; }
+    void setMargin(uint8_t percent) { _margin = percent; }
+    void setMinSamples(uint8_t nr) { _minSamples = nr; }
+
+    // The counts, for saving
+    const uint8_t * data() const { return &_counts[0][0][0]; }
+    size_t size() const { return sizeof(_counts); }
+    // Restore the counts. Returns false if the size doesn't match.
+    bool load(const uint8_t * data, size_t size);
+
+    // Returns the upper bound (ms) of bucket <ix>
+    static uint32_t bucketBound(uint8_t ix) { return (uint32_t)SIMCOM_LATENCY_FIRST_BOUND << ix; }
+    static uint8_t bucketIndex(uint32_t ms);
+
+private:
+    uint8_t _counts[SIMCOM_CMD_NR][SIMCOM_LATENCY_PHASES][SIMCOM_LATENCY_BUCKETS];
+    uint8_t _percentile;
+    uint8_t _margin;
+    uint8_t _minSamples;
+};
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_LINESOURCE_h
+#define _SIMCOM_LINESOURCE_h
+
+#include <stddef.h>
+
+/*!
+ * \brief A modem stream that hands over whole lines
+ *
+ * The lines are split before the modem code reads them, for example by
+ * the I/O thread of SIMCOM_ThreadedSerial. See SIMCOM_Modem::setLineSource().
+ * A line ends with LF, the modem sends CR LF.
+ */
+class SIMCOM_LineSource {
+public:
+    virtual ~SIMCOM_LineSource() {}
+    // Copies the next line without the CR and LF, terminated with a NUL. A
+    // longer line is cut to size - 1. Returns its length, or -1 if there is
+    // no complete line yet.
+    virtual int readLine(char * buffer, size_t size) = 0;
+    // Wait (at most timeout ms) until there is a complete line
+    virtual bool waitForLine(int timeout) = 0;
+};
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+
+#include "SIMCOM_Lock.h"
+
+#ifndef ARDUINO
+
+SIMCOM_FairLock::SIMCOM_FairLock() :
+    _depth(0),
+    _nextTicket(0)
+{
+}
+
+/*
+ * \brief The ticket of the waiting thread that gets the lock next
+ */
+uint32_t SIMCOM_FairLock::next() const
+{
+    const Waiter * best = 0;
+    for (size_t i = 0; i < _waiters.size(); ++i) {
+        const Waiter & waiter = _waiters[i];
+        if (waiter.bypassed >= SIMCOM_LOCK_MAX_BYPASS) {
+            return waiter.ticket;
+        }
+        if (!best || waiter.priority > best->priority) {
+            best = &waiter;
+        }
+    }
+    return best ? best->ticket : 0;
+}
+
+void SIMCOM_FairLock::lock(uint8_t priority)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    std::thread::id self = std::this_thread::get_id();
+    if (_depth > 0 && _owner == self) {
+        ++_depth;
+        return;
+    }
+
+    Waiter me = { _nextTicket++, priority, 0 };
+    _waiters.push_back(me);
+    _changed.wait(lock, [&] { return _depth == 0 && next() == me.ticket; });
+
+    // The ones that came before are passed over
+    size_t i = 0;
+    while (_waiters[i].ticket != me.ticket) {
+        ++_waiters[i++].bypassed;
+    }
+    _waiters.erase(_waiters.begin() + i);
+    _owner = self;
+    _depth = 1;
+}
+
+void SIMCOM_FairLock::unlock()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_depth > 0 && --_depth == 0) {
+        _owner = std::thread::id();
+        _changed.notify_all();
+    }
+}
+
+size_t SIMCOM_FairLock::waiting()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _waiters.size();
+}
+
+#endif
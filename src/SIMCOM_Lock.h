@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_LOCK_h
+#define _SIMCOM_LOCK_h
+
+#include <stddef.h>
+#include <stdint.h>
+#ifndef ARDUINO
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+/*!
+ * \brief How urgent it is to get the modem
+ */
+enum SIMCOM_Priority {
+    SIMCOM_PRIORITY_LOW,        // e.g. signal monitoring
+    SIMCOM_PRIORITY_NORMAL,     // e.g. telemetry
+    SIMCOM_PRIORITY_HIGH,       // e.g. an alarm SMS
+    SIMCOM_PRIORITY_NR
+};
+
+/*!
+ * \brief Shares one modem between tasks or threads
+ *
+ * Each public method of the modem takes the lock, so that a command
+ * and its replies are never mixed with those of another task. To keep
+ * a sequence of commands together use a SIMCOM_Transaction.
+ *
+ * The lock must be recursive: the task that has it can take it again,
+ * and must release it as many times. With FreeRTOS for example use
+ * xSemaphoreTakeRecursive() on a recursive mutex.
+ */
+class SIMCOM_Lock {
+public:
+    virtual ~SIMCOM_Lock() {}
+    virtual void lock(uint8_t priority) = 0;
+    virtual void unlock() = 0;
+};
+
+#ifndef ARDUINO
+// A waiting task is not passed over more than this, whatever its priority
+#ifndef SIMCOM_LOCK_MAX_BYPASS
+#define SIMCOM_LOCK_MAX_BYPASS          4
+#endif
+
+/*!
+ * \brief A fair, recursive lock for threads on a host
+ *
+ * When the lock is released it goes to the waiting thread with the
+ * highest priority, the one that waited longest if there are more.
+ * A thread that was passed over SIMCOM_LOCK_MAX_BYPASS times goes
+ * first, so that low priority work is not starved.
+ */
+class SIMCOM_FairLock : public SIMCOM_Lock {
+public:
+    SIMCOM_FairLock();
+
+    void lock(uint8_t priority);
+    void unlock();
+
+    // The number of threads that are waiting for the lock
+    size_t waiting();
+
+private:
+    struct Waiter {
+        uint32_t ticket;
+        uint8_t priority;
+        uint8_t bypassed;
+    };
+    uint32_t next() const;
+
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::thread::id _owner;
+    uint32_t _depth;
+    uint32_t _nextTicket;
+    std::vector<Waiter> _waiters;       // in the order of arrival
+};
+#endif
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+
+#include "SIMCOM_Log.h"
+
+SIMCOM_Log::SIMCOM_Log() :
+    _sink(0),
+    _level(SIMCOM_LOG_LEVEL),
+    _dropping(false),
+    _dropped(0),
+    _tail(0),
+    _committed(0),
+    _head(0),
+    _lineLength(0)
+{
+}
+
+size_t SIMCOM_Log::write(uint8_t c)
+{
+    if (_dropping) {
+        if (c == '\n') {
+            _dropping = false;
+        }
+        return 1;
+    }
+
+    uint16_t next = (_head + 1) % SIMCOM_LOG_BUFFER_SIZE;
+    if (next == _tail) {
+        // Full. Forget the incomplete line.
+        _head = _committed;
+        _lineLength = 0;
+        _dropping = c != '\n';
+        ++_dropped;
+        return 1;
+    }
+    _buffer[_head] = c;
+    _head = next;
+    ++_lineLength;
+    if (c == '\n' || _lineLength >= SIMCOM_LOG_BUFFER_SIZE / 2) {
+        commit();
+    }
+    return 1;
+}
+
+size_t SIMCOM_Log::write(const uint8_t *buffer, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        write(buffer[i]);
+    }
+    return size;
+}
+
+/*
+ * \brief Write as much of the complete lines as the sink takes without blocking
+ */
+void SIMCOM_Log::writeSome()
+{
+    if (!_sink) {
+        _tail = _committed;
+        return;
+    }
+    int room = _sink->availableForWrite();
+    if (room <= 0) {
+        room = SIMCOM_LOG_POLL_CHUNK;
+    }
+    size_t nr = pending(_tail, _committed);
+    if (nr > (size_t)room) {
+        nr = room;
+    }
+    while (nr > 0) {
+        // Up to the end of the buffer, or the end of what is pending
+        size_t len = SIMCOM_LOG_BUFFER_SIZE - _tail;
+        if (len > nr) {
+            len = nr;
+        }
+        _sink->write(&_buffer[_tail], len);
+        _tail = (_tail + len) % SIMCOM_LOG_BUFFER_SIZE;
+        nr -= len;
+    }
+}
+
+void SIMCOM_Log::flush()
+{
+    commit();
+    if (_sink) {
+        while (_tail != _committed) {
+            size_t len = _committed > _tail ? _committed - _tail : SIMCOM_LOG_BUFFER_SIZE - _tail;
+            _sink->write(&_buffer[_tail], len);
+            _tail = (_tail + len) % SIMCOM_LOG_BUFFER_SIZE;
+        }
+        _sink->flush();
+    }
+    _tail = _committed;
+}
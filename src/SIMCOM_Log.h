@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_LOG_h
+#define _SIMCOM_LOG_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Print.h>
+
+#define SIMCOM_LOG_NONE         0
+#define SIMCOM_LOG_ERROR        1
+#define SIMCOM_LOG_WARN         2
+#define SIMCOM_LOG_INFO         3
+#define SIMCOM_LOG_DEBUG        4
+#define SIMCOM_LOG_TRACE        5       // the echo of all modem I/O
+
+// The highest level that is compiled in. Everything above it
+// compiles to nothing, for example -DSIMCOM_LOG_LEVEL=SIMCOM_LOG_INFO
+// removes the per character echo of the modem I/O.
+#ifndef SIMCOM_LOG_LEVEL
+#define SIMCOM_LOG_LEVEL        SIMCOM_LOG_TRACE
+#endif
+
+// The size of the buffer with lines waiting to be written to the sink
+#ifndef SIMCOM_LOG_BUFFER_SIZE
+#define SIMCOM_LOG_BUFFER_SIZE  128
+#endif
+
+// How much is written per poll() if the sink can't tell (availableForWrite() is 0)
+#define SIMCOM_LOG_POLL_CHUNK   16
+
+#define SIMCOM_LOG(log, level, ...)     { if ((level) <= SIMCOM_LOG_LEVEL && (log).enabled(level)) { (log).print(__VA_ARGS__); } }
+#define SIMCOM_LOGLN(log, level, ...)   { if ((level) <= SIMCOM_LOG_LEVEL && (log).enabled(level)) { (log).println(__VA_ARGS__); } }
+
+/*!
+ * \brief A buffered log with a level
+ *
+ * Whatever is printed is kept in a ring buffer. Lines are written
+ * to the sink whole, and only when poll() is called. The modem does
+ * that while it is waiting for input, so writing to a slow diag
+ * UART doesn't hold up the modem I/O. If the buffer is full the
+ * line that is being added is dropped.
+ *
+ * A line without a newline is written when it fills half of the buffer.
+ */
+class SIMCOM_Log : public Print {
+public:
+    SIMCOM_Log();
+
+    void setSink(Print * sink) { _sink = sink; }
+    Print * getSink() const { return _sink; }
+
+    void setLevel(uint8_t level) { _level = level; }
+    uint8_t getLevel() const { return _level; }
+    bool enabled(uint8_t level) const { return _sink && level <= _level; }
+
+    // The number of lines that were dropped
+    uint16_t dropped() const { return _dropped; }
+
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+
+    // Write some of the complete lines to the sink, without blocking
+    void poll() { if (_tail != _committed) { writeSome(); } }
+
+    // Write everything, including an incomplete line, and wait for it
+    void flush();
+
+private:
+    void writeSome();
+    void commit() { _committed = _head; _lineLength = 0; }
+    size_t pending(uint16_t from, uint16_t to) const { return (to + SIMCOM_LOG_BUFFER_SIZE - from) % SIMCOM_LOG_BUFFER_SIZE; }
+
+    Print * _sink;
+    uint8_t _level;
+    bool _dropping;             // drop until the end of the line
+    uint16_t _dropped;
+    uint16_t _tail;             // the next byte to write to the sink
+    uint16_t _committed;        // the end of the complete lines
+    uint16_t _head;             // where the next byte goes
+    uint16_t _lineLength;
+    uint8_t _buffer[SIMCOM_LOG_BUFFER_SIZE];
+};
+
+#endif
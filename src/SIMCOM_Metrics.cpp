@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+#include <string.h>
+
+#include "SIMCOM_Metrics.h"
+
+void SIMCOM_Metrics::clear(uint32_t now)
+{
+    memset(command, 0, sizeof(command));
+    since = now;
+}
+
+/*
+ * \brief Print the metrics, one line per command
+ *
+ * For example:
+ *   CSQ n=12 ok=12 err=0 to=0 ms=95/101/160 tx=84 rx=336 wait=1212
+ */
+void SIMCOM_Metrics::print(Print & out) const
+{
+    for (uint8_t id = 0; id < SIMCOM_CMD_NR; ++id) {
+        const SIMCOM_CommandMetrics & m = command[id];
+        if (m.count == 0 && m.bytesRx == 0) {
+            continue;
+        }
+        out.print(reinterpret_cast<const __FlashStringHelper *>(SIMCOM_commandName(id)));
+        out.print(F(" n="));
+        out.print(m.count);
+        out.print(F(" ok="));
+        out.print(m.ok);
+        out.print(F(" err="));
+        out.print(m.error);
+        out.print(F(" to="));
+        out.print(m.timeout);
+        out.print(F(" ms="));
+        out.print(m.minLatency);
+        out.print('/');
+        out.print(m.avgLatency());
+        out.print('/');
+        out.print(m.maxLatency);
+        out.print(F(" tx="));
+        out.print(m.bytesTx);
+        out.print(F(" rx="));
+        out.print(m.bytesRx);
+        out.print(F(" wait="));
+        out.println(m.readLineTime);
+    }
+}
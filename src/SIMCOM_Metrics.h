@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_METRICS_h
+#define _SIMCOM_METRICS_h
+
+#include <stdint.h>
+#include <Print.h>
+#include "SIMCOM_Commands.h"
+
+// Uncomment this (or add -DSIMCOM_ENABLE_METRICS to the compiler flags) to
+// collect metrics per command. It costs about 1k of RAM.
+//#define SIMCOM_ENABLE_METRICS
+
+/*!
+ * \brief The counters of one command family
+ *
+ * The latency is the time from sending the command until its last
+ * reply, e.g. until "+HTTPACTION:" for AT+HTTPACTION.
+ */
+struct SIMCOM_CommandMetrics {
+    uint16_t count;             // the number of times the command was sent
+    uint16_t ok;                // ... that ended with the expected reply
+    uint16_t error;             // ... that ended with ERROR, +CME ERROR or +CMS ERROR
+    uint16_t timeout;           // ... that ended with a timeout
+    uint32_t minLatency;        // ms
+    uint32_t maxLatency;        // ms
+    uint32_t totalLatency;      // ms
+    uint32_t bytesTx;           // including data, such as the body of HTTPDATA
+    uint32_t bytesRx;
+    uint32_t readLineTime;      // ms blocked in readLine()
+
+    // The number of commands with a result
+    uint16_t results() const { return ok + error + timeout; }
+    uint32_t avgLatency() const { return results() ? totalLatency / results() : 0; }
+};
+
+/*!
+ * \brief The metrics of all command families
+ */
+struct SIMCOM_Metrics {
+    SIMCOM_CommandMetrics command[SIMCOM_CMD_NR];
+    uint32_t since;             // millis() of the last reset
+
+    void clear(uint32_t now);
+
+    // Print one line for each command that was sent
+    void print(Print & out) const;
+};
+
+#endif
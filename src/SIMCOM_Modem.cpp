@@ -24,17 +24,11 @@
 #include <stdlib.h>
 #include "SIMCOM_Modem.h"
 #include "SIMCOM_Modem_OnOff.h"
+#include "SIMCOM_Commands.h"
 
-#define DEBUG
-
-#ifdef DEBUG
-#define debugPrintLn(...) { if (this->_diagStream) this->_diagStream->println(__VA_ARGS__); }
-#define debugPrint(...) { if (this->_diagStream) this->_diagStream->print(__VA_ARGS__); }
-#warning "Debug mode is ON"
-#else
-#define debugPrintLn(...)
-#define debugPrint(...)
-#endif
+// The echo of the modem I/O
+#define debugPrintLn(...) SIMCOM_LOGLN(this->_log, SIMCOM_LOG_TRACE, __VA_ARGS__)
+#define debugPrint(...) SIMCOM_LOG(this->_log, SIMCOM_LOG_TRACE, __VA_ARGS__)
 
 #ifdef ARDUINO_ARCH_AVR
 #include <avr/wdt.h>
@@ -56,31 +50,106 @@
 
 #define SIMCOM_MODEM_TERMINATOR_LEN (sizeof(SIMCOM_MODEM_TERMINATOR) - 1) // without the NULL terminator
 
-#define SIMCOM_MODEM_DEFAULT_INPUT_BUFFER_SIZE 128
+// The default retry policies
+//   attempts, multiplier, jitter, retryOn, initial delay, max delay, deadline
+static const SIMCOM_RetryPolicy defaultPowerOnPolicy = { 10, 2, 10, SIMCOM_RETRY_ON_DEFAULT, 500, 4000, 120000 };
+static const SIMCOM_RetryPolicy defaultSignalPolicy = { 255, 2, 10, SIMCOM_RETRY_ON_DEFAULT, 500, 4000, 30000 };
+static const SIMCOM_RetryPolicy defaultBearerPolicy = { 5, 2, 10, SIMCOM_RETRY_ON_DEFAULT, 1000, 8000, 90000 };
+static const SIMCOM_RetryPolicy defaultFTPPutPolicy = { 5, 2, 10, SIMCOM_RETRY_ON_DEFAULT, 1000, 8000, 0 };
+static const SIMCOM_RetryPolicy defaultCCLKPolicy = { 10, 2, 10, SIMCOM_RETRY_ON_DEFAULT, 200, 2000, 20000 };
 
 // Constructor
 SIMCOM_Modem::SIMCOM_Modem() :
     _modemStream(0),
+    _clock(&SIMCOM_arduinoClock),
     _diagStream(0),
-    _inputBufferSize(SIMCOM_MODEM_DEFAULT_INPUT_BUFFER_SIZE),
+    _inputBufferSize(SIMCOM_MODEM_DEFAULT_BUFFER_SIZE),
     _inputBuffer(0),
     _onoff(0),
     _baudRateChangeCallbackPtr(0),
     _appendCommand(false),
     _lastRSSI(0),
     _CSQtime(0),
-    _minSignalQuality(-93)      // -93 dBm
+    _minSignalQuality(-93),     // -93 dBm
+    _cmdStart(0),
+    _cmeeMode(1),
+    _retryCallbackPtr(0),
+    _cmdId(SIMCOM_CMD_OTHER),
+    _cmdPhase(0),
+    _phaseStart(0),
+    _latencyTable(0),
+    _adaptTimeouts(false),
+    _trace(0),
+    _traceFirstRx(false),
+    _flight(0),
+    _lineSource(0),
+    _lock(0),
+    _idleCallbackPtr(0),
+    _depth(0),
+    _safePointCallbackPtr(0),
+    _safePointArg(0),
+    _safePointLevel(0),
+    _inSafePoint(false),
+    _changingPower(false),
+    _sleeping(false),
+    _sleepThreshold(0),
+    _nextTransmission(0)
 {
     this->_isBufferInitialized = false;
+    _pin[0] = '\0';
+
+    clearError();
+    _lastError.code = 0;
+    _lastError.elapsed = 0;
+    _lastError.command[0] = '\0';
+
+    _retryPolicy[SIMCOM_RETRY_POWERON] = &defaultPowerOnPolicy;
+    _retryPolicy[SIMCOM_RETRY_SIGNAL] = &defaultSignalPolicy;
+    _retryPolicy[SIMCOM_RETRY_BEARER] = &defaultBearerPolicy;
+    _retryPolicy[SIMCOM_RETRY_FTPPUT] = &defaultFTPPutPolicy;
+    _retryPolicy[SIMCOM_RETRY_CCLK] = &defaultCCLKPolicy;
+
+#ifdef SIMCOM_ENABLE_METRICS
+    _metrics.clear(0);
+    _cmdResult = SIMCOM_REPLY_NONE;
+    _cmdLatency = 0;
+    _cmdTx = 0;
+    _cmdRx = 0;
+    _cmdReadLineTime = 0;
+#endif
 }
 
 
 //SIMCOM_Modem::SIMCOM_Modem(){}
 
+/*
+ * \brief No safe points while the power state of the modem changes
+ */
+class SIMCOM_PowerChange {
+public:
+    SIMCOM_PowerChange(bool & flag) : _flag(flag), _previous(flag) { _flag = true; }
+    ~SIMCOM_PowerChange() { _flag = _previous; }
+private:
+    bool & _flag;
+    bool _previous;
+};
+
 // Turns the modem on and returns true if successful.
 bool SIMCOM_Modem::on()
 {
-    _startOn = millis();
+    SIMCOM_Transaction transaction(*this);
+    SIMCOM_PowerChange change(_changingPower);
+    _startOn = _clock->millis();
+    trace(SIMCOM_TRACE_POWER_ON, SIMCOM_CMD_OTHER);
+
+    if (_sleeping) {
+        if (wakeUp()) {
+            trace(SIMCOM_TRACE_POWER_ON_END, SIMCOM_CMD_OTHER, 1);
+            return true;
+        }
+        // Start all over
+        off();
+    }
 
     if (!isOn()) {
         if (_onoff) {
@@ -98,24 +167,106 @@ bool SIMCOM_Modem::on()
     }
 
     if (timeout) {
-        debugPrintLn("Error: No Reply from Modem");
+        SIMCOM_LOGLN(_log, SIMCOM_LOG_ERROR, F("Error: No Reply from Modem"));
+        trace(SIMCOM_TRACE_POWER_ON_END, SIMCOM_CMD_OTHER, 0);
         return false;
     }
 
-    return isOn(); // this essentially means isOn() && isAlive()
+    bool retval = isOn(); // this essentially means isOn() && isAlive()
+    trace(SIMCOM_TRACE_POWER_ON_END, SIMCOM_CMD_OTHER, retval);
+    return retval;
 }
 
 // Turns the modem off and returns true if successful.
 bool SIMCOM_Modem::off()
 {
+    SIMCOM_Transaction transaction(*this);
+    SIMCOM_PowerChange change(_changingPower);
+    trace(SIMCOM_TRACE_POWER_OFF, SIMCOM_CMD_OTHER);
     // No matter if it is on or off, turn it off.
     if (_onoff) {
         _onoff->off();
     }
 
     _echoOff = false;
+    _sleeping = false;
+    if (_onoff) {
+        _onoff->setDTR(false);
+    }
+
+    bool retval = !isOn();
+    trace(SIMCOM_TRACE_POWER_OFF_END, SIMCOM_CMD_OTHER, retval);
+    return retval;
+}
+
+bool SIMCOM_Modem::sleep()
+{
+    SIMCOM_Transaction transaction(*this);
+    SIMCOM_PowerChange change(_changingPower);
+    if (_sleeping) {
+        return true;
+    }
+    bool dtr = _onoff && _onoff->hasDTR();
+    // Mode 1: sleep while DTR is high. Mode 2: sleep when the serial line is quiet.
+    if (!sendCommandWaitForOK_P(dtr ? PSTR("AT+CSCLK=1") : PSTR("AT+CSCLK=2"))) {
+        return false;
+    }
+    if (dtr) {
+        _onoff->setDTR(true);
+    }
+    _sleeping = true;
+    SIMCOM_LOGLN(_log, SIMCOM_LOG_DEBUG, F("Modem sleeping"));
+    return true;
+}
+
+/*
+ * \brief Wake the modem from sleep
+ *
+ * Returns false if it does not reply.
+ */
+bool SIMCOM_Modem::wakeUp()
+{
+    bool dtr = _onoff && _onoff->hasDTR();
+    _sleeping = false;
+    if (dtr) {
+        _onoff->setDTR(false);
+        // The serial port is ready 50 ms after DTR went low
+        mydelay(50);
+    }
+    // In mode 2 the first characters only wake it up, isAlive() repeats the AT
+    if (!isAlive()) {
+        return false;
+    }
+    // Mode 2 would fall asleep again during a long wait for a reply
+    return dtr || sendCommandWaitForOK_P(PSTR("AT+CSCLK=0"));
+}
 
-    return !isOn();
+/*
+ * \brief Release the modem, see SIMCOM_Transaction
+ *
+ * If the transaction ended at the level of the safe point callback the
+ * callback is called first, while the modem is still locked.
+ */
+void SIMCOM_Modem::unlock()
+{
+    --_depth;
+    if (_safePointCallbackPtr && _depth >= _safePointLevel && !_inSafePoint && !_changingPower &&
+            !inDataMode()) {
+        _inSafePoint = true;
+        _safePointCallbackPtr(_safePointArg);
+        _inSafePoint = false;
+    }
+    if (_lock) {
+        _lock->unlock();
+    }
+}
+
+void SIMCOM_Modem::offOrSleep(bool ok)
+{
+    if (ok && _sleepThreshold > 0 && _nextTransmission < _sleepThreshold && sleep()) {
+        return;
+    }
+    off();
 }
 
 // Returns true if the modem is on.
@@ -131,19 +282,63 @@ bool SIMCOM_Modem::isOn() const
 
 void SIMCOM_Modem::mydelay(uint32_t nrMillis)
 {
+    trace(SIMCOM_TRACE_SLEEP_BEGIN, _cmdId, nrMillis > 0xFFFF ? 0xFFFF : nrMillis);
     const uint32_t d = 10;
     while (nrMillis > d) {
         wdt_reset();
-        delay(d);
+        _log.poll();
+        if (_idleCallbackPtr) {
+            _idleCallbackPtr(nrMillis);
+        }
+        _clock->delay(d);
         nrMillis -= d;
     }
-    delay(nrMillis);
+    _clock->delay(nrMillis);
+    trace(SIMCOM_TRACE_SLEEP_END, _cmdId);
+}
+
+/*
+ * \brief Wait before the next attempt of a retried operation
+ *
+ * The decision is based on the error of the last command. Returns
+ * false if there should be no more attempts.
+ */
+bool SIMCOM_Modem::nextAttempt(SIMCOM_Retry & retry)
+{
+    int32_t d = retry.next(_lastError.errorClass, _clock->millis());
+    if (d < 0) {
+        return false;
+    }
+    if (d > 0) {
+        mydelay(d);
+    }
+    clearError();
+    return true;
+}
+
+void SIMCOM_Modem::retryDone(SIMCOM_Retry & retry, bool success)
+{
+    retry.done(success, _clock->millis());
+    if (_retryCallbackPtr) {
+        _retryCallbackPtr(retry.stats());
+    }
+}
+
+void SIMCOM_Modem::idle(uint32_t ts_max)
+{
+    _log.poll();
+    if (_idleCallbackPtr) {
+        int32_t remaining = ts_max - _clock->millis();
+        _idleCallbackPtr(remaining > 0 ? remaining : 0);
+    }
+    _clock->idle();
 }
 
 void SIMCOM_Modem::flushInput()
 {
   int c;
   while ((c = _modemStream->read()) >= 0) {
+    countRx(1);
     debugPrint((char)c);
   }
 }
@@ -162,8 +357,29 @@ int SIMCOM_Modem::readLine(uint32_t ts_max)
   int c;
   size_t bufcnt;
 
+#ifdef SIMCOM_ENABLE_METRICS
+  uint32_t start = _clock->millis();
+#endif
   //debugPrintLn(F("readLine"));
   bufcnt = 0;
+  if (_lineSource) {
+    // The lines are already split, see SIMCOM_LineSource
+    while (!isTimedOut(ts_max)) {
+      wdt_reset();
+      int len = _lineSource->readLine(_inputBuffer, _inputBufferSize);
+      if (len >= 0) {
+        countRx(len + 2);
+        debugPrintLn(_inputBuffer);
+        bufcnt = len;
+        goto ok;
+      }
+      idle(ts_max);
+      int32_t remaining = ts_max - _clock->millis();
+      if (remaining > 0) {
+        _lineSource->waitForLine(remaining < 10 ? remaining : 10);
+      }
+    }
+  }
   while (!isTimedOut(ts_max)) {
     wdt_reset();
     if (seenCR) {
@@ -179,12 +395,14 @@ int SIMCOM_Modem::readLine(uint32_t ts_max)
 
     c = _modemStream->read();
     if (c < 0) {
+      idle(seenCR ? ts_waitLF : ts_max);
       continue;
     }
+    countRx(1);
     debugPrint((char)c);                 // echo the char
     seenCR = c == '\r';
     if (c == '\r') {
-      ts_waitLF = millis() + 50;        // Wait another .05 sec for an optional LF
+      ts_waitLF = _clock->millis() + 50;        // Wait another .05 sec for an optional LF
     } else if (c == '\n') {
       goto ok;
     } else {
@@ -195,11 +413,20 @@ int SIMCOM_Modem::readLine(uint32_t ts_max)
     }
   }
 
-  debugPrintLn(F("readLine timed out"));
+  SIMCOM_LOGLN(_log, SIMCOM_LOG_DEBUG, F("readLine timed out"));
+#ifdef SIMCOM_ENABLE_METRICS
+  _cmdReadLineTime += _clock->millis() - start;
+#endif
   return -1;            // This indicates: timed out
 
 ok:
   _inputBuffer[bufcnt] = 0;     // Terminate with NUL byte
+  if (_flight && bufcnt > 0) {
+    _flight->line(_inputBuffer, _cmdId, _clock->millis());
+  }
+#ifdef SIMCOM_ENABLE_METRICS
+  _cmdReadLineTime += _clock->millis() - start;
+#endif
   //debugPrint(F(" ")); debugPrintLn(_inputBuffer);
   return bufcnt;
 
@@ -222,8 +449,10 @@ int SIMCOM_Modem::readBytes(size_t len, uint8_t *buffer, size_t buflen, uint32_t
     wdt_reset();
     int c = _modemStream->read();
     if (c < 0) {
+      idle(ts_max);
       continue;
     }
+    countRx(1);
     // Each character is stored in the buffer
     --len;
     if (buflen > 0) {
@@ -241,20 +470,26 @@ int SIMCOM_Modem::readBytes(size_t len, uint8_t *buffer, size_t buflen, uint32_t
 bool SIMCOM_Modem::waitForOK(uint16_t timeout)
 {
   int len;
-  uint32_t ts_max = millis() + timeout;
+  uint32_t ts_max = adaptDeadline(_clock->millis() + timeout);
   while ((len = readLine(ts_max)) >= 0) {
     if (len == 0) {
       // Skip empty lines
       continue;
     }
     if (strcmp_P(_inputBuffer, PSTR("OK")) == 0) {
+      recordReply(SIMCOM_REPLY_OK);
+      clearError();
       return true;
     }
-    else if (strcmp_P(_inputBuffer, PSTR("ERROR")) == 0) {
+    else if (parseErrorResult()) {
+      recordReply(SIMCOM_REPLY_ERROR);
       return false;
     }
     // Other input is skipped.
+    traceLine();
   }
+  recordReply(SIMCOM_REPLY_TIMEOUT);
+  setError(SIMCOM_ERRKIND_TIMEOUT);
   return false;
 }
 
@@ -262,30 +497,50 @@ bool SIMCOM_Modem::waitForMessage(const char *msg, uint32_t ts_max)
 {
   int len;
   //debugPrint(F("waitForMessage: ")); debugPrintLn(msg);
+  ts_max = adaptDeadline(ts_max);
   while ((len = readLine(ts_max)) >= 0) {
     if (len == 0) {
       // Skip empty lines
       continue;
     }
     if (strncmp(_inputBuffer, msg, strlen(msg)) == 0) {
+      recordReply(SIMCOM_REPLY_OK);
       return true;
     }
+    if (parseErrorResult()) {
+      // The command failed, there is no point in waiting any longer
+      recordReply(SIMCOM_REPLY_ERROR);
+      return false;
+    }
+    traceLine();
   }
+  recordReply(SIMCOM_REPLY_TIMEOUT);
+  setError(SIMCOM_ERRKIND_TIMEOUT);
   return false;         // This indicates: timed out
 }
 bool SIMCOM_Modem::waitForMessage_P(const char *msg, uint32_t ts_max)
 {
   int len;
   //debugPrint(F("waitForMessage: ")); debugPrintLn(msg);
+  ts_max = adaptDeadline(ts_max);
   while ((len = readLine(ts_max)) >= 0) {
     if (len == 0) {
       // Skip empty lines
       continue;
     }
     if (strncmp_P(_inputBuffer, msg, strlen_P(msg)) == 0) {
+      recordReply(SIMCOM_REPLY_OK);
       return true;
     }
+    if (parseErrorResult()) {
+      // The command failed, there is no point in waiting any longer
+      recordReply(SIMCOM_REPLY_ERROR);
+      return false;
+    }
+    traceLine();
   }
+  recordReply(SIMCOM_REPLY_TIMEOUT);
+  setError(SIMCOM_ERRKIND_TIMEOUT);
   return false;         // This indicates: timed out
 }
 
@@ -293,6 +548,7 @@ int SIMCOM_Modem::waitForMessages(PGM_P msgs[], size_t nrMsgs, uint32_t ts_max)
 {
   int len;
   //debugPrint(F("waitForMessages: ")); debugPrintLn(msgs[0]);
+  ts_max = adaptDeadline(ts_max);
   while ((len = readLine(ts_max)) >= 0) {
     if (len == 0) {
       // Skip empty lines
@@ -303,13 +559,171 @@ int SIMCOM_Modem::waitForMessages(PGM_P msgs[], size_t nrMsgs, uint32_t ts_max)
       //debugPrint(F("  checking \"")); debugPrint(msgs[i]); debugPrintLn("\"");
       if (strcmp_P(_inputBuffer, msgs[i]) == 0) {
         //debugPrint(F("  found i=")); debugPrint((int)i); debugPrintLn("");
+        recordReply(SIMCOM_REPLY_OK);
         return i;
       }
     }
+    if (parseErrorResult()) {
+      // The command failed, there is no point in waiting any longer
+      recordReply(SIMCOM_REPLY_ERROR);
+      return -1;
+    }
+    traceLine();
   }
+  recordReply(SIMCOM_REPLY_TIMEOUT);
+  setError(SIMCOM_ERRKIND_TIMEOUT);
   return -1;         // This indicates: timed out
 }
 
+/*
+ * Mapping of the verbose (AT+CMEE=2) texts onto the numeric +CME ERROR
+ * and +CMS ERROR codes. All codes in the permanent lists must be here.
+ */
+struct CMEText {
+  uint16_t code;
+  char text[28];
+};
+static const CMEText cmeTexts[] PROGMEM = {
+  { 0, "phone failure" },
+  { 3, "operation not allowed" },
+  { 4, "operation not supported" },
+  { 10, "SIM not inserted" },
+  { 11, "SIM PIN required" },
+  { 12, "SIM PUK required" },
+  { 13, "SIM failure" },
+  { 14, "SIM busy" },
+  { 15, "SIM wrong" },
+  { 16, "incorrect password" },
+  { 17, "SIM PIN2 required" },
+  { 18, "SIM PUK2 required" },
+  { 20, "memory full" },
+  { 30, "no network service" },
+  { 31, "network timeout" },
+  { 262, "SIM blocked" },
+};
+static const CMEText cmsTexts[] PROGMEM = {
+  { 302, "operation not allowed" },
+  { 303, "operation not supported" },
+  { 304, "invalid PDU mode parameter" },
+  { 305, "invalid text mode parameter" },
+  { 310, "SIM not inserted" },
+  { 311, "SIM PIN required" },
+  { 312, "PH-SIM PIN required" },
+  { 313, "SIM failure" },
+  { 316, "SIM PUK required" },
+  { 317, "SIM PIN2 required" },
+  { 318, "SIM PUK2 required" },
+  { 330, "SMSC address unknown" },
+};
+
+static uint16_t lookupErrorText(const CMEText *table, size_t nr, const char *text, uint16_t unknown)
+{
+  for (size_t i = 0; i < nr; ++i) {
+    if (strcmp_P(text, table[i].text) == 0) {
+      return pgm_read_word(&table[i].code);
+    }
+  }
+  return unknown;
+}
+
+// CME and CMS codes that will not go away by retrying
+static const uint16_t cmePermanent[] PROGMEM = { 3, 4, 10, 11, 12, 13, 15, 16, 17, 18, 262 };
+static const uint16_t cmsPermanent[] PROGMEM = { 302, 303, 304, 305, 310, 311, 312, 313, 316, 317, 318, 330 };
+
+static bool inCodeList(const uint16_t *list, size_t nr, uint16_t code)
+{
+  for (size_t i = 0; i < nr; ++i) {
+    if (pgm_read_word(&list[i]) == code) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * \brief Store the details of a failure of the current command
+ */
+void SIMCOM_Modem::setError(SIMCOM_ErrorKind kind, uint16_t code)
+{
+  SIMCOM_ErrorClass errorClass = SIMCOM_ERR_REPLY;
+  switch (kind) {
+  case SIMCOM_ERRKIND_NONE:
+    errorClass = SIMCOM_ERR_NONE;
+    break;
+  case SIMCOM_ERRKIND_TIMEOUT:
+    errorClass = SIMCOM_ERR_TIMEOUT;
+    break;
+  case SIMCOM_ERRKIND_CME:
+    if (inCodeList(cmePermanent, sizeof(cmePermanent) / sizeof(cmePermanent[0]), code)) {
+      errorClass = SIMCOM_ERR_PERMANENT;
+    }
+    break;
+  case SIMCOM_ERRKIND_CMS:
+    if (inCodeList(cmsPermanent, sizeof(cmsPermanent) / sizeof(cmsPermanent[0]), code)) {
+      errorClass = SIMCOM_ERR_PERMANENT;
+    }
+    break;
+  case SIMCOM_ERRKIND_HTTP:
+    // 4xx is a problem with the request (e.g. a bad URL). 6xx is a network problem.
+    if (code >= 400 && code < 500 && code != 408 && code != 429) {
+      errorClass = SIMCOM_ERR_PERMANENT;
+    }
+    break;
+  case SIMCOM_ERRKIND_ARGUMENT:
+    errorClass = SIMCOM_ERR_PERMANENT;
+    break;
+  default:
+    break;
+  }
+  _lastError.errorClass = errorClass;
+  _lastError.kind = kind;
+  _lastError.code = code;
+  _lastError.elapsed = _clock->millis() - _cmdStart;
+}
+
+/*
+ * \brief Check if the line in the input buffer is a final error result code
+ *
+ * Recognized are "ERROR", "+CME ERROR: <err>" and "+CMS ERROR: <err>".
+ * <err> is either numeric or verbose text, depending on AT+CMEE.
+ * If it is an error the details are stored in _lastError.
+ */
+bool SIMCOM_Modem::parseErrorResult()
+{
+  SIMCOM_ErrorKind kind;
+  if (_inputBuffer[0] == 'E' && strcmp_P(_inputBuffer, PSTR("ERROR")) == 0) {
+    setError(SIMCOM_ERRKIND_ERROR);
+    return true;
+  }
+  if (_inputBuffer[0] != '+') {
+    return false;
+  }
+  if (strncmp_P(_inputBuffer, PSTR("+CME ERROR:"), 11) == 0) {
+    kind = SIMCOM_ERRKIND_CME;
+  } else if (strncmp_P(_inputBuffer, PSTR("+CMS ERROR:"), 11) == 0) {
+    kind = SIMCOM_ERRKIND_CMS;
+  } else {
+    return false;
+  }
+
+  const char *ptr = _inputBuffer + 11;
+  while (*ptr == ' ') {
+    ++ptr;
+  }
+  char *bufend;
+  uint16_t code = strtoul(ptr, &bufend, 10);
+  if (bufend == ptr) {
+    // Verbose text, 100 and 500 are unknown
+    if (kind == SIMCOM_ERRKIND_CME) {
+      code = lookupErrorText(cmeTexts, sizeof(cmeTexts) / sizeof(cmeTexts[0]), ptr, 100);
+    } else {
+      code = lookupErrorText(cmsTexts, sizeof(cmsTexts) / sizeof(cmsTexts[0]), ptr, 500);
+    }
+  }
+  setError(kind, code);
+  return true;
+}
+
 /*
  * \brief Wait for a prompt, or timeout
  *
@@ -319,6 +733,7 @@ bool SIMCOM_Modem::waitForPrompt(const char *prompt, uint32_t ts_max)
 {
   const char * ptr = prompt;
 
+  ts_max = adaptDeadline(ts_max);
   while (*ptr != '\0') {
     wdt_reset();
     if (isTimedOut(ts_max)) {
@@ -327,8 +742,10 @@ bool SIMCOM_Modem::waitForPrompt(const char *prompt, uint32_t ts_max)
 
     int c = _modemStream->read();
     if (c < 0) {
+      idle(ts_max);
       continue;
     }
+    countRx(1);
 
     debugPrint((char)c);
     switch (c) {
@@ -349,10 +766,118 @@ bool SIMCOM_Modem::waitForPrompt(const char *prompt, uint32_t ts_max)
       break;
     }
   }
-
+  if (*ptr != '\0') {
+    recordReply(SIMCOM_REPLY_TIMEOUT);
+    setError(SIMCOM_ERRKIND_TIMEOUT);
+    return false;
+  }
+  recordReply(SIMCOM_REPLY_OK);
   return true;
 }
 
+/*
+ * \brief Shorten the deadline of a reply to what was learned
+ *
+ * The learned timeout counts from the moment the command was sent, or
+ * from the previous reply of the same command. The given deadline is
+ * the upper bound.
+ */
+uint32_t SIMCOM_Modem::adaptDeadline(uint32_t ts_max)
+{
+  if (!_latencyTable || !_adaptTimeouts) {
+    return ts_max;
+  }
+  uint32_t timeout = _latencyTable->timeout(_cmdId, _cmdPhase);
+  if (timeout == 0) {
+    return ts_max;
+  }
+  uint32_t learned = _phaseStart + timeout;
+  // Give input that already arrived a chance
+  uint32_t earliest = _clock->millis() + SIMCOM_LATENCY_MIN_TIMEOUT;
+  if ((int32_t)(learned - earliest) < 0) {
+    learned = earliest;
+  }
+  if ((int32_t)(learned - ts_max) < 0) {
+    return learned;
+  }
+  return ts_max;
+}
+
+/*
+ * \brief Record the time of a reply (or timeout) of the current command
+ */
+void SIMCOM_Modem::recordReply(SIMCOM_ReplyResult result)
+{
+  uint32_t now = _clock->millis();
+  trace(SIMCOM_TRACE_RESULT, _cmdId, result);
+  if (_flight && result == SIMCOM_REPLY_TIMEOUT) {
+    _flight->timeout(_cmdId, now);
+  }
+  if (_latencyTable) {
+    _latencyTable->record(_cmdId, _cmdPhase, now - _phaseStart);
+  }
+#ifdef SIMCOM_ENABLE_METRICS
+  _cmdResult = result;
+  _cmdLatency = now - _cmdStart;
+#else
+  (void)result;
+#endif
+  if (_cmdPhase < 0xFF) {
+    ++_cmdPhase;
+  }
+  _phaseStart = now;
+}
+
+#ifdef SIMCOM_ENABLE_METRICS
+/*
+ * \brief Add the counters of the previous command to the metrics
+ */
+void SIMCOM_Modem::finishCommandMetrics()
+{
+  SIMCOM_CommandMetrics & m = _metrics.command[_cmdId];
+  switch (_cmdResult) {
+  case SIMCOM_REPLY_OK:
+    ++m.ok;
+    break;
+  case SIMCOM_REPLY_ERROR:
+    ++m.error;
+    break;
+  case SIMCOM_REPLY_TIMEOUT:
+    ++m.timeout;
+    break;
+  default:
+    break;
+  }
+  if (_cmdResult != SIMCOM_REPLY_NONE) {
+    if (m.results() == 1 || _cmdLatency < m.minLatency) {
+      m.minLatency = _cmdLatency;
+    }
+    if (_cmdLatency > m.maxLatency) {
+      m.maxLatency = _cmdLatency;
+    }
+    m.totalLatency += _cmdLatency;
+  }
+  m.bytesTx += _cmdTx;
+  m.bytesRx += _cmdRx;
+  m.readLineTime += _cmdReadLineTime;
+
+  _cmdResult = SIMCOM_REPLY_NONE;
+  _cmdTx = 0;
+  _cmdRx = 0;
+  _cmdReadLineTime = 0;
+}
+#endif
+
+/*
+ * \brief Trace the line in the input buffer if it is a URC
+ */
+void SIMCOM_Modem::traceLine()
+{
+  if (_trace && _inputBuffer[0] == '+') {
+    trace(SIMCOM_TRACE_URC, SIMCOM_classifyReply(_inputBuffer));
+  }
+}
+
 /*
  * \brief Prepare for a new command
  */
@@ -360,7 +885,32 @@ void SIMCOM_Modem::sendCommandProlog()
 {
   flushInput();
   mydelay(50);                  // Without this we get lots of "readLine timed out". Unclear why
+#ifdef SIMCOM_ENABLE_METRICS
+  finishCommandMetrics();
+#endif
   debugPrint(F(">> "));
+  _lastError.command[0] = '\0';
+  _cmdStart = _clock->millis();
+}
+
+/*
+ * \brief Keep the start of the command that is being sent, for error reporting
+ */
+void SIMCOM_Modem::recordCommand(const char *cmd, bool progmem)
+{
+  if (_flight) {
+    _flight->commandText(cmd, progmem);
+  }
+  size_t len = strlen(_lastError.command);
+  while (len < sizeof(_lastError.command) - 1) {
+    char c = progmem ? pgm_read_byte(cmd) : *cmd;
+    if (c == '\0') {
+      break;
+    }
+    _lastError.command[len++] = c;
+    ++cmd;
+  }
+  _lastError.command[len] = '\0';
 }
 
 /*
@@ -368,30 +918,83 @@ void SIMCOM_Modem::sendCommandProlog()
  */
 void SIMCOM_Modem::sendCommandAdd(char c)
 {
+  char str[2] = { c, '\0' };
+  recordCommand(str, false);
+  countTx(1);
   debugPrint(c);
   _modemStream->print(c);
 }
 void SIMCOM_Modem::sendCommandAdd(int i)
 {
+  char str[12];
+  recordCommand(itoa(i, str, 10), false);
+  countTx(strlen(str));
+  debugPrint(i);
+  _modemStream->print(i);
+}
+void SIMCOM_Modem::sendCommandAdd(unsigned long i)
+{
+  char str[12];
+  recordCommand(ultoa(i, str, 10), false);
+  countTx(strlen(str));
   debugPrint(i);
   _modemStream->print(i);
 }
 void SIMCOM_Modem::sendCommandAdd(const char *cmd)
 {
+  recordCommand(cmd, false);
+  countTx(strlen(cmd));
   debugPrint(cmd);
   _modemStream->print(cmd);
 }
 void SIMCOM_Modem::sendCommandAdd(const String & cmd)
 {
+  recordCommand(cmd.c_str(), false);
+  countTx(cmd.length());
   debugPrint(cmd);
   _modemStream->print(cmd);
 }
 void SIMCOM_Modem::sendCommandAdd_P(const char *cmd)
 {
+  recordCommand(cmd, true);
+  countTx(strlen_P(cmd));
   debugPrint(reinterpret_cast<const __FlashStringHelper *>(cmd));
   _modemStream->print(reinterpret_cast<const __FlashStringHelper *>(cmd));
 }
 
+/*
+ * \brief Check that a string can be sent in double quotes
+ *
+ * A double quote in the string would end it early, and the SIMCOM
+ * modems don't take an escape for it. The string is rejected with
+ * a permanent error instead. This must be done before the command
+ * is started, a half sent command can't be taken back.
+ */
+bool SIMCOM_Modem::checkQuotable(const char *str)
+{
+  if (str && strchr(str, '"') != NULL) {
+    _lastError.command[0] = '\0';
+    _cmdStart = _clock->millis();
+    setError(SIMCOM_ERRKIND_ARGUMENT);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * \brief Add a string in double quotes
+ *
+ * A NULL string is sent as "". The string must have passed checkQuotable().
+ */
+void SIMCOM_Modem::sendCommandAddQuoted(const char *str)
+{
+  sendCommandAdd('"');
+  if (str) {
+    sendCommandAdd(str);
+  }
+  sendCommandAdd('"');
+}
+
 /*
  * \brief Send the final CR of the command
  */
@@ -399,6 +1002,18 @@ void SIMCOM_Modem::sendCommandEpilog()
 {
   debugPrintLn();
   _modemStream->print('\r');
+  countTx(1);
+  _cmdId = SIMCOM_classifyCommand(_lastError.command);
+  _cmdPhase = 0;
+  _phaseStart = _clock->millis();
+  trace(SIMCOM_TRACE_COMMAND, _cmdId);
+  _traceFirstRx = _trace != 0;
+  if (_flight) {
+    _flight->commandSent(_cmdId, _phaseStart);
+  }
+#ifdef SIMCOM_ENABLE_METRICS
+  ++_metrics.command[_cmdId].count;
+#endif
 }
 
 void SIMCOM_Modem::sendCommand(const char *cmd)
@@ -413,6 +1028,17 @@ void SIMCOM_Modem::sendCommand_P(const char *cmd)
   sendCommandAdd_P(cmd);
   sendCommandEpilog();
 }
+bool SIMCOM_Modem::sendQuotedCommand_P(const char *cmd, const char *str)
+{
+  if (!checkQuotable(str)) {
+    return false;
+  }
+  sendCommandProlog();
+  sendCommandAdd_P(cmd);
+  sendCommandAddQuoted(str);
+  sendCommandEpilog();
+  return true;
+}
 
 /*
  * \brief Send a command to the SIM900 and wait for "OK"
@@ -423,19 +1049,30 @@ void SIMCOM_Modem::sendCommand_P(const char *cmd)
  */
 bool SIMCOM_Modem::sendCommandWaitForOK(const char *cmd, uint16_t timeout)
 {
+  SIMCOM_Transaction transaction(*this);
   sendCommand(cmd);
   return waitForOK(timeout);
 }
 bool SIMCOM_Modem::sendCommandWaitForOK(const String & cmd, uint16_t timeout)
 {
+  SIMCOM_Transaction transaction(*this);
   sendCommand(cmd.c_str());
   return waitForOK(timeout);
 }
 bool SIMCOM_Modem::sendCommandWaitForOK_P(const char *cmd, uint16_t timeout)
 {
+  SIMCOM_Transaction transaction(*this);
   sendCommand_P(cmd);
   return waitForOK(timeout);
 }
+bool SIMCOM_Modem::sendQuotedCommandWaitForOK_P(const char *cmd, const char *str, uint16_t timeout)
+{
+  SIMCOM_Transaction transaction(*this);
+  if (!sendQuotedCommand_P(cmd, str)) {
+    return false;
+  }
+  return waitForOK(timeout);
+}
 
 /*
  * \brief Get SIM900 integer value
@@ -744,7 +1381,7 @@ size_t SIMCOM_Modem::println(void)
 // Safe to call multiple times.
 void SIMCOM_Modem::initBuffer()
 {
-    debugPrintLn("[initBuffer]");
+    SIMCOM_LOGLN(_log, SIMCOM_LOG_DEBUG, F("[initBuffer]"));
 
     // make sure the buffers are only initialized once
     if (!_isBufferInitialized) {
@@ -754,6 +1391,13 @@ void SIMCOM_Modem::initBuffer()
     }
 }
 
+void SIMCOM_Modem::setInputBuffer(char * buffer, size_t size)
+{
+    _inputBuffer = buffer;
+    _inputBufferSize = size;
+    _isBufferInitialized = true;
+}
+
 // Sets the modem stream.
 void SIMCOM_Modem::setModemStream(Stream& stream)
 {
@@ -762,9 +1406,8 @@ void SIMCOM_Modem::setModemStream(Stream& stream)
 
 void SIMCOM_Modem::setPin(const char * pin)
 {
-    size_t len = strlen(pin);
-    _pin = static_cast<char*>(realloc(_pin, len + 1));
-    strcpy(_pin, pin);
+    strncpy(_pin, pin, sizeof(_pin) - 1);
+    _pin[sizeof(_pin) - 1] = '\0';
 }
 
 void SIMCOM_Modem::setMinSignalQuality(int q)
@@ -26,11 +26,28 @@
 #include <Stream.h>
 #include "SIMCOM_Datetime.h"
 #include "SIMCOM_Modem_OnOff.h"
+#include "SIMCOM_Retry.h"
+#include "SIMCOM_Latency.h"
+#include "SIMCOM_Metrics.h"
+#include "SIMCOM_Trace.h"
+#include "SIMCOM_FlightRecorder.h"
+#include "SIMCOM_Log.h"
+#include "SIMCOM_Clock.h"
+#include "SIMCOM_Lock.h"
+#include "SIMCOM_LineSource.h"
 
 // callback for changing the baudrate of the modem stream.
 typedef void (*BaudRateChangeCallbackPtr)(uint32_t newBaudrate);
 
+// callback while waiting for the modem, with the time (ms) that is left until the deadline.
+typedef void (*SIMCOM_IdleCallbackPtr)(uint32_t remaining);
+
+// callback at a safe point between two AT transactions, see setSafePointCallback().
+typedef void (*SIMCOM_SafePointCallbackPtr)(void * arg);
+
 #define SIMCOM_MODEM_DEFAULT_BUFFER_SIZE      64
+// A PIN is at most 8 digits
+#define SIMCOM_MODEM_PIN_SIZE                 9
 #define DEFAULT_READ_MS 5000 // Used in readResponse()
 
 class SIMCOM_Modem {
@@ -50,14 +67,79 @@ public:
     // Turns the modem off and returns true if successful.
     bool off();
 
+    // Puts the modem to sleep (AT+CSCLK) and returns true if successful.
+    // It stays registered to the network, on() wakes it up. With a DTR line
+    // (see SIMCOM_Modem_OnOff::hasDTR) sleep mode 1 is used, otherwise mode 2.
+    bool sleep();
+    bool isSleeping() const { return _sleeping; }
+
+    // At the end of an operation the modem is put to sleep instead of switched
+    // off, if the next transmission is expected within <threshold> ms. Waking
+    // up takes less than a second, a cold start with network registration
+    // easily takes 10 to 30 seconds. 0 (the default) always switches off.
+    void setSleepThreshold(uint32_t threshold) { _sleepThreshold = threshold; }
+    // Sets the expected time (ms) until the next transmission
+    void setNextTransmission(uint32_t ms) { _nextTransmission = ms; }
+    // At the end of an operation: switch off, or sleep if it went well and
+    // the next transmission is soon
+    void offOrSleep(bool ok);
+
+    // Sets the clock, for example a SIMCOM_VirtualClock in host tests.
+    // The clock must stay valid.
+    void setClock(SIMCOM_Clock & clock) { _clock = &clock; }
+    SIMCOM_Clock & getClock() const { return *_clock; }
+
+    // Sets the (optional) lock to share the modem between tasks or threads,
+    // see SIMCOM_Lock.h. Set it before the tasks start. The lock must stay valid.
+    void setLock(SIMCOM_Lock * lock) { _lock = lock; }
+
+    // Takes and releases the modem, see SIMCOM_Transaction.
+    // Without a lock only the depth is counted.
+    void lock(uint8_t priority = SIMCOM_PRIORITY_NORMAL) { if (_lock) { _lock->lock(priority); } ++_depth; }
+    void unlock();
+    // The number of transactions that are open
+    uint8_t getDepth() const { return _depth; }
+
+    // Sets the (optional) callback at a safe point: each time a transaction
+    // ends and at least <level> transactions are still open, e.g. when the
+    // HTTPDATA step of doHTTPPOST() is done and HTTPACTION is next. The modem
+    // is then between two AT transactions, and still has the lock. It is not
+    // called from within the callback, while the modem is switched on, off or
+    // to sleep, nor while a TCP connection is in transparent mode.
+    // See SIMCOM_CommandScheduler.
+    void setSafePointCallback(SIMCOM_SafePointCallbackPtr callback, void * arg, uint8_t level)
+    {
+        _safePointCallbackPtr = callback;
+        _safePointArg = arg;
+        _safePointLevel = level;
+    }
+
     // Sets the optional "Diagnostics and Debug" stream.
-    void setDiag(Stream &stream) { _diagStream = &stream; }
-    void setDiag(Stream *stream) { _diagStream = stream; }
+    void setDiag(Stream &stream) { _diagStream = &stream; _log.setSink(&stream); }
+    void setDiag(Stream *stream) { _diagStream = stream; _log.setSink(stream); }
+
+    // Sets the (optional) callback that is called while waiting for the modem:
+    // each time there is no input, and every 10 ms of a delay. E.g. to service
+    // sensors or feed a watchdog. It must return before the next bytes from
+    // the modem overflow the serial buffer.
+    void setIdleCallback(SIMCOM_IdleCallbackPtr callback) { _idleCallbackPtr = callback; }
+
+    // Sets the level of the diag output, SIMCOM_LOG_NONE ... SIMCOM_LOG_TRACE.
+    // Levels above SIMCOM_LOG_LEVEL are not compiled in.
+    void setLogLevel(uint8_t level) { _log.setLevel(level); }
+
+    // The diag output is buffered and written while waiting for the modem.
+    // Call this to write it now, e.g. before going to sleep.
+    void flushLog() { _log.flush(); }
 
     // Sets the size of the input buffer.
     // Needs to be called before init().
     void setInputBufferSize(size_t value) { this->_inputBufferSize = value; };
 
+    // Use the given buffer as input buffer instead of allocating one. The
+    // buffer must stay valid. Needs to be called before init().
+    void setInputBuffer(char * buffer, size_t size);
+
     // Store APN and user and password
     void setApn(const char *apn, const char *user = NULL, const char *pass = NULL);
     void setApnUser(const char *user);
@@ -110,24 +192,76 @@ public:
     bool sendCommandWaitForOK(const String & cmd, uint16_t timeout=4000);
     bool sendCommandWaitForOK_P(const char *cmd, uint16_t timeout=4000);
 
+    // Returns the details of the failure of the last command.
+    const SIMCOM_Error & getLastError() const { return _lastError; }
+    SIMCOM_ErrorClass getLastErrorClass() const { return _lastError.errorClass; }
+
+    // Sets the AT+CMEE mode, 1 (default) for numeric and 2 for verbose error codes.
+    // It is sent when echo is switched off. The verbose texts are mapped back to
+    // the codes, but a module may use texts that are not known here.
+    void setErrorReportMode(uint8_t mode) { _cmeeMode = mode; }
+
+    // Sets how an operation is retried. The policy object must stay valid.
+    void setRetryPolicy(SIMCOM_RetryOperation op, const SIMCOM_RetryPolicy & policy) { _retryPolicy[op] = &policy; }
+    const SIMCOM_RetryPolicy & getRetryPolicy(SIMCOM_RetryOperation op) const { return *_retryPolicy[op]; }
+
+    // Sets the optional callback that records the attempts of each retried operation.
+    void setRetryCallback(SIMCOM_RetryCallbackPtr callback) { _retryCallbackPtr = callback; }
+
+    // Sets the (optional) table to record the reply time of each command.
+    // If adapt is true the timeouts are shortened to what was learned, the
+    // usual timeouts remain the upper bound. The table must stay valid.
+    void setLatencyTable(SIMCOM_LatencyTable * table, bool adapt = true) { _latencyTable = table; _adaptTimeouts = adapt; }
+    SIMCOM_LatencyTable * getLatencyTable() const { return _latencyTable; }
+
+    // Sets the (optional) ring to record trace events. The ring must stay valid.
+    void setTrace(SIMCOM_TraceRing * trace) { _trace = trace; }
+    SIMCOM_TraceRing * getTrace() const { return _trace; }
+
+    // Sets the (optional) recorder of the last commands and replies. Dump
+    // it when an operation fails. The recorder must stay valid.
+    void setFlightRecorder(SIMCOM_FlightRecorder * recorder) { _flight = recorder; }
+    SIMCOM_FlightRecorder * getFlightRecorder() const { return _flight; }
+
+    // Sets the (optional) source of whole lines. It must be the modem stream
+    // as well, e.g. a SIMCOM_ThreadedSerial. readLine() then takes a line at
+    // a time instead of a byte at a time. The source must stay valid.
+    void setLineSource(SIMCOM_LineSource * source) { _lineSource = source; }
+
+#ifdef SIMCOM_ENABLE_METRICS
+    // Returns the metrics since the last reset, including the most
+    // recent command.
+    const SIMCOM_Metrics & getMetrics() { finishCommandMetrics(); return _metrics; }
+    void getMetrics(SIMCOM_Metrics & snapshot) { finishCommandMetrics(); snapshot = _metrics; }
+    // The counters of the most recent command are dropped as well.
+    void resetMetrics() { finishCommandMetrics(); _metrics.clear(_clock->millis()); }
+#endif
+
 protected:
     // The stream that communicates with the device.
     Stream* _modemStream;
 
+    // All timing goes through this clock
+    SIMCOM_Clock * _clock;
+
     // The (optional) stream to show debug information.
     Stream* _diagStream;
 
-    // The size of the input buffer. Equals SODAQ_GSM_MODEM_DEFAULT_INPUT_BUFFER_SIZE
-    // by default or (optionally) a user-defined value when using USE_DYNAMIC_BUFFER.
+    // The buffer for the diag output
+    SIMCOM_Log _log;
+
+    // The size of the input buffer. Equals SIMCOM_MODEM_DEFAULT_BUFFER_SIZE
+    // by default or (optionally) a user-defined value.
     size_t _inputBufferSize;
 
     // Flag to make sure the buffers are not allocated more than once.
     bool _isBufferInitialized;
 
-    // The buffer used when reading from the modem. The space is allocated during init() via initBuffer().
+    // The buffer used when reading from the modem. The space is allocated during init() via initBuffer(),
+    // unless it was given with setInputBuffer().
     char* _inputBuffer;
 
-    char * _pin;
+    char _pin[SIMCOM_MODEM_PIN_SIZE];
 
     // The on-off pin power controller object.
     SIMCOM_Modem_OnOff * _onoff;
@@ -162,11 +296,109 @@ protected:
     // Keep track when connect started. Use this to record various status changes.
     uint32_t _startOn;
 
+    // The details of the failure of the last command. The command
+    // text is also used to record the command that is being sent.
+    SIMCOM_Error _lastError;
+
+    // Keep track when the current command was sent
+    uint32_t _cmdStart;
+
+    // The AT+CMEE mode
+    uint8_t _cmeeMode;
+
+    // The retry policy of each operation
+    const SIMCOM_RetryPolicy * _retryPolicy[SIMCOM_RETRY_NR];
+
+    // The (optional) callback to record the retries
+    SIMCOM_RetryCallbackPtr _retryCallbackPtr;
+
+    // The family of the current command (SIMCOM_CommandId)
+    uint8_t _cmdId;
+
+    // The number of replies of the current command so far
+    uint8_t _cmdPhase;
+
+    // Keep track when the current command was sent, or when the previous reply came in
+    uint32_t _phaseStart;
+
+    // The (optional) table with reply times
+    SIMCOM_LatencyTable * _latencyTable;
+    bool _adaptTimeouts;
+
+#ifdef SIMCOM_ENABLE_METRICS
+    SIMCOM_Metrics _metrics;
+
+    // The counters of the current command, these are added to
+    // the metrics when the next command starts
+    uint8_t _cmdResult;         // SIMCOM_ReplyResult of the last reply
+    uint32_t _cmdLatency;
+    uint32_t _cmdTx;
+    uint32_t _cmdRx;
+    uint32_t _cmdReadLineTime;
+
+    void finishCommandMetrics();
+    void countTx(size_t nr) { _cmdTx += nr; }
+#else
+    void countTx(size_t) {}
+#endif
+    void countRx(size_t nr) {
+#ifdef SIMCOM_ENABLE_METRICS
+        _cmdRx += nr;
+#else
+        (void)nr;
+#endif
+        if (_traceFirstRx) {
+            _traceFirstRx = false;
+            trace(SIMCOM_TRACE_FIRST_RX, _cmdId);
+        }
+    }
+
+    // The (optional) ring with trace events
+    SIMCOM_TraceRing * _trace;
+
+    // Set when the command is sent, to trace the first byte of the reply
+    bool _traceFirstRx;
+
+    // The (optional) recorder of the last commands and replies
+    SIMCOM_FlightRecorder * _flight;
+
+    // The (optional) source of whole lines
+    SIMCOM_LineSource * _lineSource;
+
+    // The (optional) lock to share the modem
+    SIMCOM_Lock * _lock;
+
+    // The (optional) callback while waiting
+    SIMCOM_IdleCallbackPtr _idleCallbackPtr;
+
+    // The number of open transactions, and the (optional) callback at a safe point
+    uint8_t _depth;
+    SIMCOM_SafePointCallbackPtr _safePointCallbackPtr;
+    void * _safePointArg;
+    uint8_t _safePointLevel;
+    bool _inSafePoint;
+    bool _changingPower;
+
+    // Sleep instead of off, see setSleepThreshold()
+    bool _sleeping;
+    uint32_t _sleepThreshold;
+    uint32_t _nextTransmission;
+
+    bool wakeUp();
+
+    void trace(uint8_t type, uint8_t cmd, uint16_t arg = 0) { if (_trace) { _trace->add(_clock->micros(), type, cmd, arg); } }
+    void traceLine();
+
     // Initializes the input buffer and makes sure it is only initialized once.
     // Safe to call multiple times.
     void initBuffer();
 
     void mydelay(uint32_t nrMillis);
+
+    // Wait before the next attempt. Returns false if we must give up.
+    bool nextAttempt(SIMCOM_Retry & retry);
+    // Finish a retried operation, and record it.
+    void retryDone(SIMCOM_Retry & retry, bool success);
     // Returns true if the modem is ON (and replies to "AT" commands without timing out)
     virtual bool isAlive() = 0;
 
@@ -175,11 +407,25 @@ protected:
 
     virtual void switchEchoOff() = 0;
 
+    // Returns true if the modem takes data instead of AT commands, e.g. TCP in
+    // transparent mode. There are no safe points then.
+    virtual bool inDataMode() { return false; }
+
     // Sets the modem stream.
     void setModemStream(Stream& stream);
 
     // Small utility to see if we timed out
-    bool isTimedOut(uint32_t ts) { return (long)(millis() - ts) >= 0; }
+    bool isTimedOut(uint32_t ts) { return (int32_t)(_clock->millis() - ts) >= 0; }
+
+    // Called while waiting for input from the modem, until ts_max
+    void idle(uint32_t ts_max);
+
+    void setError(SIMCOM_ErrorKind kind, uint16_t code = 0);
+    void clearError() { _lastError.errorClass = SIMCOM_ERR_NONE; _lastError.kind = SIMCOM_ERRKIND_NONE; }
+    bool parseErrorResult();
+    void recordCommand(const char *cmd, bool progmem);
+    uint32_t adaptDeadline(uint32_t ts_max);
+    void recordReply(SIMCOM_ReplyResult result);
 
     void flushInput();
     int readLine(uint32_t ts_max);
@@ -193,13 +439,19 @@ protected:
     void sendCommandProlog();
     void sendCommandAdd(char c);
     void sendCommandAdd(int i);
+    void sendCommandAdd(unsigned long i);
     void sendCommandAdd(const char *cmd);
     void sendCommandAdd(const String & cmd);
     void sendCommandAdd_P(const char *cmd);
+    bool checkQuotable(const char *str);
+    void sendCommandAddQuoted(const char *str);
     void sendCommandEpilog();
 
     void sendCommand(const char *cmd);
     void sendCommand_P(const char *cmd);
+    // Send <cmd>"<str>". Returns false if <str> has a double quote.
+    bool sendQuotedCommand_P(const char *cmd, const char *str);
+    bool sendQuotedCommandWaitForOK_P(const char *cmd, const char *str, uint16_t timeout=4000);
 
     bool getIntValue(const char *cmd, const char *reply, int * value, uint32_t ts_max);
     bool getIntValue_P(const char *cmd, const char *reply, int * value, uint32_t ts_max);
@@ -239,4 +491,25 @@ protected:
     size_t println(void);
 };
 
+/*!
+ * \brief Has the modem for a sequence of commands
+ *
+ * The lock of the modem is taken until the end of the scope, so that
+ * no other task sends commands in between. For example
+ *   {
+ *       SIMCOM_Transaction transaction(gprsbee, SIMCOM_PRIORITY_HIGH);
+ *       gprsbee.setHTTPParamsSession(url, contentType, 0);
+ *       ...
+ *       gprsbee.doHTTPACTION(1, &status);
+ *   }
+ * Other tasks get the modem between transactions, e.g. for a CSQ.
+ */
+class SIMCOM_Transaction {
+public:
+    SIMCOM_Transaction(SIMCOM_Modem & modem, uint8_t priority = SIMCOM_PRIORITY_NORMAL) : _modem(modem) { _modem.lock(priority); }
+    ~SIMCOM_Transaction() { _modem.unlock(); }
+private:
+    SIMCOM_Modem & _modem;
+};
+
 #endif
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+
+#include "SIMCOM_ModemPool.h"
+
+#ifndef ARDUINO
+#define POOL_LOCK()     std::unique_lock<std::mutex> lock(_mutex)
+#else
+#define POOL_LOCK()
+#endif
+
+SIMCOM_ModemPool::SIMCOM_ModemPool() :
+    _count(0),
+    _running(0)
+#ifndef ARDUINO
+    , _stopping(false)
+#endif
+{
+}
+
+SIMCOM_ModemPool::~SIMCOM_ModemPool()
+{
+#ifndef ARDUINO
+    stop();
+#endif
+}
+
+bool SIMCOM_ModemPool::post(SIMCOM_Modem & modem, Job job, void * arg)
+{
+    POOL_LOCK();
+    if (_count >= SIMCOM_POOL_MAX_JOBS) {
+        return false;
+    }
+    Entry & entry = _jobs[_count++];
+    entry.modem = &modem;
+    entry.job = job;
+    entry.arg = arg;
+#ifndef ARDUINO
+    _changed.notify_one();
+#endif
+    return true;
+}
+
+size_t SIMCOM_ModemPool::pending()
+{
+    POOL_LOCK();
+    return _count + _running;
+}
+
+bool SIMCOM_ModemPool::isBusy(SIMCOM_Modem * modem) const
+{
+    for (size_t i = 0; i < _running; ++i) {
+        if (_busy[i] == modem) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * \brief Take the oldest job of a modem that is not busy
+ *
+ * Must be called with the lock held.
+ */
+bool SIMCOM_ModemPool::take(Entry & entry)
+{
+    if (_running >= sizeof(_busy) / sizeof(_busy[0])) {
+        return false;
+    }
+    for (size_t i = 0; i < _count; ++i) {
+        if (isBusy(_jobs[i].modem)) {
+            continue;
+        }
+        entry = _jobs[i];
+        --_count;
+        for (size_t j = i; j < _count; ++j) {
+            _jobs[j] = _jobs[j + 1];
+        }
+        _busy[_running++] = entry.modem;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * \brief The job of the modem is done
+ *
+ * Must be called with the lock held.
+ */
+void SIMCOM_ModemPool::release(SIMCOM_Modem * modem)
+{
+    for (size_t i = 0; i < _running; ++i) {
+        if (_busy[i] == modem) {
+            _busy[i] = _busy[--_running];
+            break;
+        }
+    }
+#ifndef ARDUINO
+    _changed.notify_all();
+#endif
+}
+
+bool SIMCOM_ModemPool::poll()
+{
+    Entry entry;
+    {
+        POOL_LOCK();
+        if (!take(entry)) {
+            return false;
+        }
+    }
+    entry.job(*entry.modem, entry.arg);
+    POOL_LOCK();
+    release(entry.modem);
+    return true;
+}
+
+#ifndef ARDUINO
+void SIMCOM_ModemPool::start(size_t threads)
+{
+    if (threads > SIMCOM_POOL_MAX_THREADS) {
+        threads = SIMCOM_POOL_MAX_THREADS;
+    }
+    _stopping = false;
+    while (_threads.size() < threads) {
+        _threads.push_back(std::thread(&SIMCOM_ModemPool::worker, this));
+    }
+}
+
+void SIMCOM_ModemPool::stop()
+{
+    {
+        POOL_LOCK();
+        _stopping = true;
+        _changed.notify_all();
+    }
+    for (size_t i = 0; i < _threads.size(); ++i) {
+        _threads[i].join();
+    }
+    _threads.clear();
+}
+
+void SIMCOM_ModemPool::wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_count + _running > 0) {
+        _changed.wait(lock);
+    }
+}
+
+void SIMCOM_ModemPool::worker()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        Entry entry;
+        if (take(entry)) {
+            lock.unlock();
+            entry.job(*entry.modem, entry.arg);
+            lock.lock();
+            release(entry.modem);
+            continue;
+        }
+        if (_stopping && _count == 0) {
+            break;
+        }
+        _changed.wait(lock);
+    }
+}
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_MODEMPOOL_h
+#define _SIMCOM_MODEMPOOL_h
+
+#include <stddef.h>
+#include <stdint.h>
+#ifndef ARDUINO
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+#include "SIMCOM_Modem.h"
+
+// The number of jobs that can be queued
+#ifndef SIMCOM_POOL_MAX_JOBS
+#define SIMCOM_POOL_MAX_JOBS            32
+#endif
+// The number of threads that can run jobs at the same time
+#ifndef SIMCOM_POOL_MAX_THREADS
+#define SIMCOM_POOL_MAX_THREADS         16
+#endif
+
+/*!
+ * \brief Runs jobs on a number of modems
+ *
+ * A job is a function that does something with one modem, e.g. an
+ * HTTP POST. The jobs of one modem are run in the order they were
+ * posted, and never two at the same time. The jobs of different
+ * modems may run at the same time.
+ *
+ * Call poll() from the main loop to run the jobs one by one. On a host
+ * (not ARDUINO) start() creates threads to run them instead. Each
+ * modem must then have its own stream, clock and diag stream.
+ */
+class SIMCOM_ModemPool {
+public:
+    typedef void (*Job)(SIMCOM_Modem & modem, void * arg);
+
+    SIMCOM_ModemPool();
+    ~SIMCOM_ModemPool();
+
+    // Queue a job. Returns false if the queue is full.
+    bool post(SIMCOM_Modem & modem, Job job, void * arg = 0);
+
+    // Run one job. Returns false if there was none that could run.
+    bool poll();
+
+    // The number of jobs that are queued or running
+    size_t pending();
+
+#ifndef ARDUINO
+    // Start the threads, at most SIMCOM_POOL_MAX_THREADS
+    void start(size_t threads);
+    // Wait until all jobs are done, then stop the threads
+    void stop();
+    // Wait until all jobs are done
+    void wait();
+#endif
+
+private:
+    struct Entry {
+        SIMCOM_Modem * modem;
+        Job job;
+        void * arg;
+    };
+    bool take(Entry & entry);
+    void release(SIMCOM_Modem * modem);
+    bool isBusy(SIMCOM_Modem * modem) const;
+#ifndef ARDUINO
+    void worker();
+#endif
+
+    Entry _jobs[SIMCOM_POOL_MAX_JOBS];
+    size_t _count;
+    // The modems with a running job. One extra for poll().
+    SIMCOM_Modem * _busy[SIMCOM_POOL_MAX_THREADS + 1];
+    size_t _running;
+#ifndef ARDUINO
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::vector<std::thread> _threads;
+    bool _stopping;
+#endif
+};
+
+#endif
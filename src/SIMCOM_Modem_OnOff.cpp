@@ -11,6 +11,7 @@ GPRSBeeOnOff::GPRSBeeOnOff()
     _vcc33Pin = -1;
     _onoffPin = -1;
     _statusPin = -1;
+    _dtrPin = -1;
 }
 
 // Initializes the instance
@@ -67,6 +68,23 @@ void GPRSBeeOnOff::off()
     delay(50);
 }
 
+void GPRSBeeOnOff::setDtrPin(int8_t dtrPin)
+{
+    _dtrPin = dtrPin;
+    if (_dtrPin >= 0) {
+        // Low is awake
+        digitalWrite(_dtrPin, LOW);
+        pinMode(_dtrPin, OUTPUT);
+    }
+}
+
+void GPRSBeeOnOff::setDTR(bool high)
+{
+    if (_dtrPin >= 0) {
+        digitalWrite(_dtrPin, high ? HIGH : LOW);
+    }
+}
+
 bool GPRSBeeOnOff::isOn()
 {
     if (_statusPin >= 0) {
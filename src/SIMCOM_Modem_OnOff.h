@@ -16,6 +16,11 @@ public:
     virtual void on() = 0;
     virtual void off() = 0;
     virtual bool isOn() = 0;
+
+    // The DTR line of the modem, for sleep mode (AT+CSCLK=1). The modem
+    // sleeps while DTR is high. The default is that there is none.
+    virtual bool hasDTR() { return false; }
+    virtual void setDTR(bool high) { (void)high; }
 };
 
 class GPRSBeeOnOff : public SIMCOM_Modem_OnOff
@@ -26,12 +31,18 @@ class GPRSBeeOnOff : public SIMCOM_Modem_OnOff
         void on();
         void off();
         bool isOn();
+
+        // Sets the pin that drives DTR of the modem, to wake it from sleep
+        void setDtrPin(int8_t dtrPin);
+        bool hasDTR() { return _dtrPin >= 0; }
+        void setDTR(bool high);
         
     
     private:
         int8_t _vcc33Pin = -1;
         int8_t _onoffPin = -1;
         int8_t _statusPin = -1;
+        int8_t _dtrPin = -1;
     
 };
 #endif /* _SIMCOM_MODEM_ONOFF_H_ */
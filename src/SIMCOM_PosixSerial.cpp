@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef ARDUINO
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "SIMCOM_PosixSerial.h"
+
+SIMCOM_PosixSerial::SIMCOM_PosixSerial() :
+    _fd(-1),
+    _head(0),
+    _tail(0)
+{
+}
+
+SIMCOM_PosixSerial::~SIMCOM_PosixSerial()
+{
+    close();
+}
+
+bool SIMCOM_PosixSerial::open(const char * path, uint32_t baud, bool rtsCts)
+{
+    close();
+    _fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (_fd < 0) {
+        return false;
+    }
+    if (!configure(baud, rtsCts)) {
+        int err = errno;
+        close();
+        errno = err;
+        return false;
+    }
+    tcflush(_fd, TCIOFLUSH);
+    return true;
+}
+
+bool SIMCOM_PosixSerial::openPty(char * slaveName, size_t size)
+{
+    close();
+    _fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (_fd < 0) {
+        return false;
+    }
+    const char * name = 0;
+    if (grantpt(_fd) != 0 || unlockpt(_fd) != 0 || (name = ptsname(_fd)) == 0 ||
+            strlen(name) >= size) {
+        close();
+        return false;
+    }
+    strcpy(slaveName, name);
+    // No echo, no line editing
+    struct termios tio;
+    if (tcgetattr(_fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(_fd, TCSANOW, &tio);
+    }
+    return true;
+}
+
+void SIMCOM_PosixSerial::close()
+{
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _head = 0;
+    _tail = 0;
+}
+
+static speed_t toSpeed(uint32_t baud)
+{
+    switch (baud) {
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+#ifdef B460800
+    case 460800: return B460800;
+#endif
+#ifdef B921600
+    case 921600: return B921600;
+#endif
+    default: return B0;
+    }
+}
+
+bool SIMCOM_PosixSerial::configure(uint32_t baud, bool rtsCts)
+{
+    speed_t speed = toSpeed(baud);
+    struct termios tio;
+    if (speed == B0) {
+        errno = EINVAL;
+        return false;
+    }
+    if (tcgetattr(_fd, &tio) != 0) {
+        return false;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+#ifdef CRTSCTS
+    if (rtsCts) {
+        tio.c_cflag |= CRTSCTS;
+    } else {
+        tio.c_cflag &= ~CRTSCTS;
+    }
+#else
+    (void)rtsCts;
+#endif
+    // Non-blocking reads
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    return tcsetattr(_fd, TCSANOW, &tio) == 0;
+}
+
+bool SIMCOM_PosixSerial::setBaud(uint32_t baud)
+{
+    struct termios tio;
+    speed_t speed = toSpeed(baud);
+    if (_fd < 0 || speed == B0 || tcgetattr(_fd, &tio) != 0) {
+        return false;
+    }
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    return tcsetattr(_fd, TCSADRAIN, &tio) == 0;
+}
+
+bool SIMCOM_PosixSerial::setFlowControl(bool rtsCts)
+{
+#ifdef CRTSCTS
+    struct termios tio;
+    if (_fd < 0 || tcgetattr(_fd, &tio) != 0) {
+        return false;
+    }
+    if (rtsCts) {
+        tio.c_cflag |= CRTSCTS;
+    } else {
+        tio.c_cflag &= ~CRTSCTS;
+    }
+    return tcsetattr(_fd, TCSADRAIN, &tio) == 0;
+#else
+    return !rtsCts;
+#endif
+}
+
+bool SIMCOM_PosixSerial::waitForInput(int timeout)
+{
+    if (_head != _tail) {
+        return true;
+    }
+    if (_fd < 0) {
+        return false;
+    }
+    struct pollfd pfd = { _fd, POLLIN, 0 };
+    return ::poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN);
+}
+
+/*
+ * \brief Read what the kernel has, if the buffer is empty
+ *
+ * Returns true if there is something in the buffer.
+ */
+bool SIMCOM_PosixSerial::fill()
+{
+    if (_head != _tail) {
+        return true;
+    }
+    if (_fd < 0) {
+        return false;
+    }
+    ssize_t nr;
+    do {
+        nr = ::read(_fd, _buffer, sizeof(_buffer));
+    } while (nr < 0 && errno == EINTR);
+    if (nr <= 0) {
+        return false;
+    }
+    _head = nr;
+    _tail = 0;
+    return true;
+}
+
+int SIMCOM_PosixSerial::available()
+{
+    fill();
+    return _head - _tail;
+}
+
+int SIMCOM_PosixSerial::peek()
+{
+    return fill() ? _buffer[_tail] : -1;
+}
+
+int SIMCOM_PosixSerial::read()
+{
+    return fill() ? _buffer[_tail++] : -1;
+}
+
+size_t SIMCOM_PosixSerial::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t SIMCOM_PosixSerial::write(const uint8_t * buffer, size_t size)
+{
+    size_t done = 0;
+    while (_fd >= 0 && done < size) {
+        ssize_t nr = ::write(_fd, buffer + done, size - done);
+        if (nr > 0) {
+            done += nr;
+        } else if (nr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // The kernel buffer is full, or CTS is low
+            struct pollfd pfd = { _fd, POLLOUT, 0 };
+            int ready = ::poll(&pfd, 1, SIMCOM_POSIX_WRITE_TIMEOUT);
+            if (ready == 0 || (ready < 0 && errno != EINTR)) {
+                break;
+            }
+        } else if (nr < 0 && errno == EINTR) {
+            continue;
+        } else {
+            break;
+        }
+    }
+    return done;
+}
+
+void SIMCOM_PosixSerial::flush()
+{
+    if (_fd >= 0 && isatty(_fd)) {
+        tcdrain(_fd);
+    }
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_POSIXSERIAL_h
+#define _SIMCOM_POSIXSERIAL_h
+
+#ifndef ARDUINO
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Stream.h>
+
+// The number of bytes asked from the kernel in one read
+#ifndef SIMCOM_POSIX_READ_SIZE
+#define SIMCOM_POSIX_READ_SIZE          1024
+#endif
+
+// The number of ms that a write waits for the port to take more bytes
+#ifndef SIMCOM_POSIX_WRITE_TIMEOUT
+#define SIMCOM_POSIX_WRITE_TIMEOUT      2000
+#endif
+
+/*!
+ * \brief A Stream over a serial port (tty) or pty of a POSIX host
+ *
+ * This makes it possible to run the modem code on a Linux gateway,
+ * e.g. with a USB-serial modem:
+ *   SIMCOM_PosixSerial serial;
+ *   serial.open("/dev/ttyUSB0", 115200);
+ *   modem.init(serial, onoff);
+ * The file descriptor is non-blocking. Reading is done in batches of
+ * SIMCOM_POSIX_READ_SIZE. Writing waits until the kernel took all the
+ * bytes, unless the port takes nothing for SIMCOM_POSIX_WRITE_TIMEOUT
+ * ms (e.g. CTS stays low). Then the number of bytes that were written
+ * is returned. Use fd() to add the port to an epoll or poll set.
+ *
+ * For tests, openPty() gives a pty pair: the modem code talks to the
+ * master side, a simulated modem opens the slave side.
+ */
+class SIMCOM_PosixSerial : public Stream {
+public:
+    SIMCOM_PosixSerial();
+    ~SIMCOM_PosixSerial();
+
+    // Open a tty. Returns false if that fails, errno tells why.
+    bool open(const char * path, uint32_t baud, bool rtsCts = false);
+    // Open the master side of a new pty, and give the name of the slave side
+    bool openPty(char * slaveName, size_t size);
+    void close();
+    bool isOpen() const { return _fd >= 0; }
+    int fd() const { return _fd; }
+
+    // Change the baud rate, e.g. from the BaudRateChangeCallbackPtr
+    bool setBaud(uint32_t baud);
+    bool setFlowControl(bool rtsCts);
+
+    // Wait (at most timeout ms) until there is something to read
+    bool waitForInput(int timeout);
+
+    int available();
+    int peek();
+    int read();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t * buffer, size_t size);
+    using Print::write;
+    // Waits until all bytes are sent
+    void flush();
+
+private:
+    bool fill();
+    bool configure(uint32_t baud, bool rtsCts);
+
+    int _fd;
+    size_t _head;
+    size_t _tail;
+    uint8_t _buffer[SIMCOM_POSIX_READ_SIZE];
+};
+
+#endif
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "SIMCOM_Reply.h"
+
+static bool isWhiteSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+SIMCOM_ReplyParser::SIMCOM_ReplyParser(const char * line, const char * prefix) :
+    _ptr(line)
+{
+    if (prefix) {
+        size_t len = strlen_P(prefix);
+        _ptr = strncmp_P(line, prefix, len) == 0 ? line + len : 0;
+    }
+    if (_ptr) {
+        skipWhiteSpace();
+    }
+}
+
+void SIMCOM_ReplyParser::skipWhiteSpace()
+{
+    while (isWhiteSpace(*_ptr)) {
+        ++_ptr;
+    }
+}
+
+/*
+ * \brief Move past the comma after a field
+ *
+ * Returns false if there is something else than white space before it.
+ * Whatever is left of the field is skipped.
+ */
+bool SIMCOM_ReplyParser::endField()
+{
+    skipWhiteSpace();
+    bool clean = *_ptr == ',' || *_ptr == '\0';
+    while (*_ptr != ',' && *_ptr != '\0') {
+        ++_ptr;
+    }
+    if (*_ptr == ',') {
+        ++_ptr;
+        skipWhiteSpace();
+    }
+    return clean;
+}
+
+bool SIMCOM_ReplyParser::nextInt(long & value)
+{
+    if (atEnd()) {
+        return false;
+    }
+    bool negative = *_ptr == '-';
+    if (negative || *_ptr == '+') {
+        ++_ptr;
+    }
+    if (*_ptr < '0' || *_ptr > '9') {
+        endField();
+        return false;
+    }
+    long result = 0;
+    while (*_ptr >= '0' && *_ptr <= '9') {
+        result = result * 10 + (*_ptr++ - '0');
+    }
+    if (!endField()) {
+        return false;
+    }
+    value = negative ? -result : result;
+    return true;
+}
+
+bool SIMCOM_ReplyParser::nextInt(int & value)
+{
+    long result;
+    if (!nextInt(result)) {
+        return false;
+    }
+    value = result;
+    return true;
+}
+
+bool SIMCOM_ReplyParser::nextString(char * buffer, size_t size)
+{
+    if (atEnd()) {
+        return false;
+    }
+    size_t len = 0;
+    if (*_ptr == '"') {
+        ++_ptr;
+        while (*_ptr != '"' && *_ptr != '\0') {
+            if (len < size - 1) {
+                buffer[len++] = *_ptr;
+            }
+            ++_ptr;
+        }
+        if (*_ptr == '"') {
+            ++_ptr;
+        }
+    } else {
+        const char * start = _ptr;
+        while (*_ptr != ',' && *_ptr != '\0') {
+            ++_ptr;
+        }
+        if (_ptr == start) {
+            // An empty field
+            endField();
+            return false;
+        }
+        const char * end = _ptr;
+        while (end > start && isWhiteSpace(end[-1])) {
+            --end;
+        }
+        while (start < end && len < size - 1) {
+            buffer[len++] = *start++;
+        }
+    }
+    buffer[len] = '\0';
+    endField();
+    return true;
+}
+
+void SIMCOM_ReplyParser::skip()
+{
+    if (atEnd()) {
+        return;
+    }
+    if (*_ptr == '"') {
+        // A comma in the string is not the end of the field
+        const char * end = strchr(_ptr + 1, '"');
+        _ptr = end ? end + 1 : _ptr + strlen(_ptr);
+    }
+    endField();
+}
+
+int SIMCOM_scanReply(const char * line, const char * format, ...)
+{
+    // The prefix is up to the first field or space
+    const char * fmt = format;
+    while (pgm_read_byte(fmt) != '\0' && pgm_read_byte(fmt) != '%' && pgm_read_byte(fmt) != ' ') {
+        ++fmt;
+    }
+    if (strncmp_P(line, format, fmt - format) != 0) {
+        return -1;
+    }
+    SIMCOM_ReplyParser parser(line + (fmt - format));
+
+    va_list args;
+    va_start(args, format);
+    int count = 0;
+    char c;
+    while ((c = pgm_read_byte(fmt++)) != '\0' && !parser.atEnd()) {
+        if (c != '%') {
+            // The parser takes care of the commas and the white space
+            continue;
+        }
+        switch (pgm_read_byte(fmt++)) {
+        case 'd':
+            if (parser.nextInt(*va_arg(args, int *))) {
+                ++count;
+            }
+            break;
+        case 'l':
+            if (parser.nextInt(*va_arg(args, long *))) {
+                ++count;
+            }
+            break;
+        case 's':
+            {
+                char * buffer = va_arg(args, char *);
+                size_t size = va_arg(args, size_t);
+                if (parser.nextString(buffer, size)) {
+                    ++count;
+                }
+            }
+            break;
+        case '*':
+            parser.skip();
+            break;
+        default:
+            // Bad format
+            va_end(args);
+            return count;
+        }
+    }
+    va_end(args);
+    return count;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_REPLY_h
+#define _SIMCOM_REPLY_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ * \brief A single pass tokenizer of the fields of a reply line
+ *
+ * The fields are separated by commas, a string field may be in double
+ * quotes. White space around the fields is ignored, so "+HTTPACTION:1,200,11"
+ * (SIM900) and "+HTTPACTION: 1,200,11" (SIM800) give the same fields.
+ * Nothing is copied unless a string field is asked for.
+ */
+class SIMCOM_ReplyParser {
+public:
+    // If prefix (PROGMEM) is given the line must start with it, the
+    // first field is after the prefix.
+    SIMCOM_ReplyParser(const char * line, const char * prefix = 0);
+
+    // False if the line does not start with the prefix
+    bool isValid() const { return _ptr != 0; }
+    // True if there are no more fields
+    bool atEnd() const { return !_ptr || *_ptr == '\0'; }
+
+    // Each of these moves to the next field. They return false if the
+    // field is empty, absent or of another type.
+    bool nextInt(long & value);
+    bool nextInt(int & value);
+    // The string is always terminated. It is truncated if it does not
+    // fit. The quotes are removed.
+    bool nextString(char * buffer, size_t size);
+    void skip();
+
+private:
+    void skipWhiteSpace();
+    bool endField();
+
+    const char * _ptr;
+};
+
+/*!
+ * \brief Parse a reply line as described by a (PROGMEM) format
+ *
+ * The format is the prefix followed by the fields, e.g.
+ *   SIMCOM_scanReply(line, PSTR("+CSQ: %d,%d"), &rssi, &ber)
+ * A space matches any amount of white space, including none.
+ *   %d  int *
+ *   %l  long *
+ *   %s  char *, size_t (the size of the buffer)
+ *   %*  any field, skipped
+ * A field that is empty leaves the value as it is. The fields at the
+ * end of the line may be absent (optional fields).
+ *
+ * Returns the number of values that were stored, or -1 if the line
+ * does not start with the prefix.
+ */
+int SIMCOM_scanReply(const char * line, const char * format, ...);
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+
+#include "SIMCOM_Retry.h"
+
+uint32_t SIMCOM_RetryPolicy::backoff(uint8_t attempt) const
+{
+    uint32_t d = initialDelay;
+    for (uint8_t i = 2; i < attempt && d < maxDelay; ++i) {
+        d *= multiplier;
+    }
+    if (d > maxDelay) {
+        d = maxDelay;
+    }
+    return d;
+}
+
+SIMCOM_Retry::SIMCOM_Retry(uint8_t operation, const SIMCOM_RetryPolicy & policy, uint32_t now) :
+    _policy(policy),
+    _start(now)
+{
+    _stats.operation = operation;
+    _stats.attempts = 0;
+    _stats.success = false;
+    _stats.lastError = SIMCOM_ERR_NONE;
+    _stats.elapsed = 0;
+    _stats.waited = 0;
+}
+
+int32_t SIMCOM_Retry::next(SIMCOM_ErrorClass lastError, uint32_t now)
+{
+    if (_stats.attempts == 0) {
+        _stats.attempts = 1;
+        return 0;
+    }
+
+    _stats.lastError = lastError;
+    if (_stats.attempts >= _policy.maxAttempts) {
+        return -1;
+    }
+    if ((_policy.retryOn & SIMCOM_RETRY_ON(lastError)) == 0) {
+        return -1;
+    }
+
+    uint32_t d = _policy.backoff(_stats.attempts + 1);
+    if (_policy.jitterPercent > 0 && d > 0) {
+        // Spread the delay evenly over +/- jitter
+        uint32_t span = d * _policy.jitterPercent / 100;
+        d = d - span + random(2 * span + 1);
+    }
+    if (_policy.deadline > 0 && (now - _start) + d >= _policy.deadline) {
+        // The next attempt would start too late
+        return -1;
+    }
+
+    ++_stats.attempts;
+    _stats.waited += d;
+    return d;
+}
+
+void SIMCOM_Retry::done(bool success, uint32_t now)
+{
+    _stats.success = success;
+    if (success) {
+        _stats.lastError = SIMCOM_ERR_NONE;
+    }
+    _stats.elapsed = now - _start;
+}
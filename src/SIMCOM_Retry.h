@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_RETRY_h
+#define _SIMCOM_RETRY_h
+
+#include <stdint.h>
+#include "SIMCOM_Error.h"
+
+// Bit masks of error classes, used for SIMCOM_RetryPolicy::retryOn
+#define SIMCOM_RETRY_ON(err)    (1 << (err))
+#define SIMCOM_RETRY_ON_DEFAULT (SIMCOM_RETRY_ON(SIMCOM_ERR_NONE) | SIMCOM_RETRY_ON(SIMCOM_ERR_TIMEOUT) | SIMCOM_RETRY_ON(SIMCOM_ERR_REPLY))
+
+/*!
+ * \brief The operations that are retried by the library
+ */
+enum SIMCOM_RetryOperation {
+    SIMCOM_RETRY_POWERON,       // on() in getUnixEpoch
+    SIMCOM_RETRY_SIGNAL,        // CSQ in waitForSignalQuality
+    SIMCOM_RETRY_BEARER,        // AT+SAPBR=1,1 in setBearerParms
+    SIMCOM_RETRY_FTPPUT,        // AT+FTPPUT=1 in openFTPfile
+    SIMCOM_RETRY_CCLK,          // AT+CCLK? in getUnixEpoch
+    SIMCOM_RETRY_NR
+};
+
+/*!
+ * \brief How to retry an operation
+ *
+ * The delay before attempt n+1 is initialDelay * multiplier^(n-1),
+ * limited to maxDelay, plus or minus jitter percent. No attempt
+ * is started after the deadline (0 means no deadline), and an
+ * error class that is not in retryOn stops immediately.
+ */
+struct SIMCOM_RetryPolicy {
+    uint8_t maxAttempts;
+    uint8_t multiplier;
+    uint8_t jitterPercent;
+    uint8_t retryOn;
+    uint16_t initialDelay;      // ms
+    uint16_t maxDelay;          // ms
+    uint32_t deadline;          // ms since the first attempt
+
+    // Returns the delay (without jitter) before attempt number <attempt> (2, 3, ...)
+    uint32_t backoff(uint8_t attempt) const;
+};
+
+/*!
+ * \brief The record of one retried operation
+ */
+struct SIMCOM_RetryStats {
+    uint8_t operation;          // SIMCOM_RetryOperation
+    uint8_t attempts;
+    bool success;
+    SIMCOM_ErrorClass lastError;
+    uint32_t elapsed;           // ms, including the waiting
+    uint32_t waited;            // ms spent in backoff
+};
+
+// Callback to record the attempts of each retried operation
+typedef void (*SIMCOM_RetryCallbackPtr)(const SIMCOM_RetryStats & stats);
+
+/*!
+ * \brief The state of one retried operation
+ */
+class SIMCOM_Retry {
+public:
+    SIMCOM_Retry(uint8_t operation, const SIMCOM_RetryPolicy & policy, uint32_t now);
+
+    // Returns the delay (ms) before the next attempt, or -1 if we must give up.
+    // The first call is for the first attempt, and it returns 0.
+    int32_t next(SIMCOM_ErrorClass lastError, uint32_t now);
+
+    void done(bool success, uint32_t now);
+    const SIMCOM_RetryStats & stats() const { return _stats; }
+
+private:
+    const SIMCOM_RetryPolicy & _policy;
+    uint32_t _start;
+    SIMCOM_RetryStats _stats;
+};
+
+#endif
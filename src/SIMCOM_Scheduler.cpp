@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+#include <string.h>
+
+#include "SIMCOM_Scheduler.h"
+
+#ifndef ARDUINO
+#define SCHEDULER_LOCK()        std::unique_lock<std::mutex> lock(_mutex)
+#else
+#define SCHEDULER_LOCK()
+#endif
+
+SIMCOM_CommandScheduler::SIMCOM_CommandScheduler(SIMCOM_Modem & modem) :
+    _modem(modem),
+    _count(0),
+    _running(-1)
+{
+    resetStats();
+}
+
+bool SIMCOM_CommandScheduler::post(Job job, void * arg, uint8_t priority, uint32_t deadline)
+{
+    if (priority >= SIMCOM_PRIORITY_NR) {
+        priority = SIMCOM_PRIORITY_NR - 1;
+    }
+    uint32_t now = _modem.getClock().millis();
+    SCHEDULER_LOCK();
+    if (_count >= SIMCOM_SCHEDULER_MAX_JOBS) {
+        return false;
+    }
+    Entry & entry = _jobs[_count++];
+    entry.job = job;
+    entry.arg = arg;
+    entry.priority = priority;
+    entry.hasDeadline = deadline != 0;
+    entry.posted = now;
+    entry.deadline = now + deadline;
+    return true;
+}
+
+size_t SIMCOM_CommandScheduler::pending()
+{
+    SCHEDULER_LOCK();
+    return _count;
+}
+
+SIMCOM_SchedulerStats SIMCOM_CommandScheduler::getStats(uint8_t priority)
+{
+    SCHEDULER_LOCK();
+    return _stats[priority < SIMCOM_PRIORITY_NR ? priority : SIMCOM_PRIORITY_NR - 1];
+}
+
+void SIMCOM_CommandScheduler::resetStats()
+{
+    SCHEDULER_LOCK();
+    memset(_stats, 0, sizeof(_stats));
+}
+
+/*
+ * \brief Should job a go before job b?
+ *
+ * The jobs are kept in the order they were posted, so a tie goes to
+ * the one that is first in the queue.
+ */
+bool SIMCOM_CommandScheduler::isBefore(const Entry & a, const Entry & b)
+{
+    if (a.priority != b.priority) {
+        return a.priority > b.priority;
+    }
+    if (a.hasDeadline != b.hasDeadline) {
+        return a.hasDeadline;
+    }
+    return a.hasDeadline && (int32_t)(a.deadline - b.deadline) < 0;
+}
+
+/*
+ * \brief Take the next job with at least the given priority
+ *
+ * Jobs that passed their deadline are dropped on the way.
+ */
+bool SIMCOM_CommandScheduler::take(Entry & entry, int minPriority)
+{
+    uint32_t now = _modem.getClock().millis();
+    SCHEDULER_LOCK();
+    size_t i = 0;
+    while (i < _count) {
+        if (_jobs[i].hasDeadline && (int32_t)(now - _jobs[i].deadline) > 0) {
+            ++_stats[_jobs[i].priority].expired;
+            remove(i);
+        } else {
+            ++i;
+        }
+    }
+    size_t best = _count;
+    for (i = 0; i < _count; ++i) {
+        if (_jobs[i].priority >= minPriority && (best == _count || isBefore(_jobs[i], _jobs[best]))) {
+            best = i;
+        }
+    }
+    if (best == _count) {
+        return false;
+    }
+    entry = _jobs[best];
+    remove(best);
+
+    SIMCOM_SchedulerStats & stats = _stats[entry.priority];
+    uint32_t delay = now - entry.posted;
+    ++stats.run;
+    stats.totalDelay += delay;
+    if (delay > stats.maxDelay) {
+        stats.maxDelay = delay;
+    }
+    return true;
+}
+
+void SIMCOM_CommandScheduler::remove(size_t ix)
+{
+    --_count;
+    memmove(&_jobs[ix], &_jobs[ix + 1], (_count - ix) * sizeof(_jobs[0]));
+}
+
+void SIMCOM_CommandScheduler::run(const Entry & entry)
+{
+    int previous = _running;
+    _running = entry.priority;
+    if (previous < 0) {
+        // A step of an operation of the job is at one transaction deeper
+        _modem.setSafePointCallback(safePoint, this, _modem.getDepth() + 1);
+    }
+    entry.job(_modem, entry.arg);
+    if (previous < 0) {
+        _modem.setSafePointCallback(0, 0, 0);
+    }
+    _running = previous;
+}
+
+void SIMCOM_CommandScheduler::safePoint(void * arg)
+{
+    static_cast<SIMCOM_CommandScheduler *>(arg)->preempt();
+}
+
+bool SIMCOM_CommandScheduler::poll()
+{
+    Entry entry;
+    if (!take(entry, 0)) {
+        return false;
+    }
+    run(entry);
+    return true;
+}
+
+bool SIMCOM_CommandScheduler::preempt()
+{
+    bool retval = false;
+    Entry entry;
+    while (_running >= 0 && take(entry, _running + 1)) {
+        run(entry);
+        retval = true;
+    }
+    return retval;
+}
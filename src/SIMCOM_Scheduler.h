@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_SCHEDULER_h
+#define _SIMCOM_SCHEDULER_h
+
+#include <stddef.h>
+#include <stdint.h>
+#ifndef ARDUINO
+#include <mutex>
+#endif
+#include "SIMCOM_Modem.h"
+
+// The number of jobs that can be queued
+#ifndef SIMCOM_SCHEDULER_MAX_JOBS
+#define SIMCOM_SCHEDULER_MAX_JOBS       16
+#endif
+
+/*!
+ * \brief The queueing delay of the jobs of one priority
+ */
+struct SIMCOM_SchedulerStats {
+    uint32_t run;               // jobs that were started
+    uint32_t expired;           // jobs that were dropped at their deadline
+    uint32_t totalDelay;        // ms from post() until the start, of all jobs that were run
+    uint32_t maxDelay;          // ms
+
+    uint32_t averageDelay() const { return run ? totalDelay / run : 0; }
+};
+
+/*!
+ * \brief Runs the operations of one modem by priority
+ *
+ * A job is a function that does one operation with the modem, e.g.
+ * sendSMS() or doHTTPPOST(). The job with the highest priority runs
+ * first. Within a priority the job with the earliest deadline goes
+ * first, and then the one that was posted first. A job that has not
+ * started at its deadline is dropped.
+ *
+ * Call poll() from the main loop. While a job runs, the jobs of a
+ * higher priority are run at each safe point of the modem: when a step
+ * of an operation of the job is done, see setSafePointCallback(). For
+ * example a telemetry upload with doHTTPPOST() lets an alarm SMS go
+ * before its HTTPACTION, instead of after it. A job can also call
+ * preempt() itself, e.g. between two of its commands.
+ *
+ * The jobs that run at a safe point must leave the modem as they found
+ * it: on, and not in the middle of a command. So an alarm job uses
+ * sendSMSKeepPower(), sendSMS() would switch the modem off.
+ *   void alarm(SIMCOM_Modem & modem, void * arg)
+ *   {
+ *       static_cast<SIMx00 &>(modem).sendSMSKeepPower("+31600000000", (const char *)arg);
+ *   }
+ *   scheduler.post(alarm, (void *)"Door open", SIMCOM_PRIORITY_HIGH, 60000);
+ *
+ * The scheduler sets the safe point callback of the modem while a job
+ * runs, only one scheduler can be used per modem.
+ */
+class SIMCOM_CommandScheduler {
+public:
+    typedef void (*Job)(SIMCOM_Modem & modem, void * arg);
+
+    SIMCOM_CommandScheduler(SIMCOM_Modem & modem);
+
+    // Queue a job. The deadline is in ms from now, 0 for none. Returns
+    // false if the queue is full.
+    bool post(Job job, void * arg = 0, uint8_t priority = SIMCOM_PRIORITY_NORMAL, uint32_t deadline = 0);
+
+    // Run the next job. Returns false if there was none.
+    bool poll();
+
+    // Run the jobs with a higher priority than the running job. Returns
+    // true if any was run.
+    bool preempt();
+
+    // The number of jobs that are queued
+    size_t pending();
+
+    // The queueing delay of the jobs of the given priority
+    SIMCOM_SchedulerStats getStats(uint8_t priority);
+    void resetStats();
+
+private:
+    struct Entry {
+        Job job;
+        void * arg;
+        uint8_t priority;
+        bool hasDeadline;
+        uint32_t posted;        // ms
+        uint32_t deadline;      // ms
+    };
+    bool take(Entry & entry, int minPriority);
+    void remove(size_t ix);
+    void run(const Entry & entry);
+    static bool isBefore(const Entry & a, const Entry & b);
+    static void safePoint(void * arg);
+
+    SIMCOM_Modem & _modem;
+    Entry _jobs[SIMCOM_SCHEDULER_MAX_JOBS];
+    size_t _count;
+    int _running;               // the priority of the running job, -1 if none
+    SIMCOM_SchedulerStats _stats[SIMCOM_PRIORITY_NR];
+#ifndef ARDUINO
+    std::mutex _mutex;
+#endif
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_SPSCQUEUE_h
+#define _SIMCOM_SPSCQUEUE_h
+
+#ifndef ARDUINO
+
+#include <stddef.h>
+#include <atomic>
+
+/*!
+ * \brief A lock-free queue for one producer thread and one consumer thread
+ *
+ * N must be a power of two. The counters run freely, the index is the
+ * counter modulo N.
+ */
+template <typename T, size_t N>
+class SIMCOM_SpscQueue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+public:
+    SIMCOM_SpscQueue() : _head(0), _tail(0) {}
+
+    // Producer side
+    bool push(const T & value)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= N) {
+            return false;
+        }
+        _data[head & (N - 1)] = value;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    size_t push(const T * values, size_t nr)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t room = N - (head - _tail.load(std::memory_order_acquire));
+        if (nr > room) {
+            nr = room;
+        }
+        for (size_t i = 0; i < nr; ++i) {
+            _data[(head + i) & (N - 1)] = values[i];
+        }
+        _head.store(head + nr, std::memory_order_release);
+        return nr;
+    }
+    size_t room() const { return N - size(); }
+
+    // Consumer side
+    bool pop(T & value)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = _data[tail & (N - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    // The first element, or NULL if the queue is empty
+    const T * front() const
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return 0;
+        }
+        return &_data[tail & (N - 1)];
+    }
+    // The elements that can be popped without wrapping around
+    size_t contiguous(const T ** first) const
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        size_t nr = _head.load(std::memory_order_acquire) - tail;
+        size_t index = tail & (N - 1);
+        if (nr > N - index) {
+            nr = N - index;
+        }
+        *first = &_data[index];
+        return nr;
+    }
+    void drop(size_t nr) { _tail.store(_tail.load(std::memory_order_relaxed) + nr, std::memory_order_release); }
+
+    // Either side
+    size_t size() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+
+private:
+    // On separate cache lines, each is written by one side only
+    alignas(64) std::atomic<size_t> _head;
+    alignas(64) std::atomic<size_t> _tail;
+    alignas(64) T _data[N];
+};
+
+#endif
+
+#endif
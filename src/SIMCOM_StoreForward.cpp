@@ -0,0 +1,540 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+
+#include "SIMCOM_StoreForward.h"
+
+#if defined(ARDUINO_ARCH_AVR)
+#include <EEPROM.h>
+#endif
+
+/*
+ * Record layout
+ *   0  magic
+ *   1  state, 0xFF pending, 0x00 sent
+ *   2  length of the data (LSB first)
+ *   4  CRC16 of length and data (LSB first)
+ *   6  data
+ * The magic is written last, so an incomplete record is not seen.
+ */
+#define SF_MAGIC        0xA5
+#define SF_PENDING      0xFF
+#define SF_SENT         0x00
+#define SF_HEADER_SIZE  6
+
+#define SF_CHUNK_SIZE   16
+
+/*
+ * The journal of a compaction, in the last bytes of rewritable storage
+ *   0  magic
+ *   1  offset of the records that are moved to the start (LSB first)
+ *   5  their size (LSB first)
+ * The magic is written last, and cleared when the move is done.
+ */
+#define SF_JOURNAL_MAGIC        0x5A
+#define SF_JOURNAL_SIZE         9
+
+// CRC-16/CCITT
+static uint16_t crc16(uint16_t crc, const uint8_t * data, size_t len)
+{
+    while (len-- > 0) {
+        crc ^= (uint16_t)*data++ << 8;
+        for (uint8_t i = 0; i < 8; ++i) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////    Storage backends   /////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ARDUINO
+SIMCOM_FileStorage::SIMCOM_FileStorage(const char * path, uint32_t capacity) :
+    _path(path),
+    _capacity(capacity),
+    _file(0)
+{
+    _file = fopen(path, "r+b");
+    if (!_file) {
+        _file = fopen(path, "w+b");
+    }
+}
+
+SIMCOM_FileStorage::~SIMCOM_FileStorage()
+{
+    if (_file) {
+        fclose(_file);
+    }
+}
+
+bool SIMCOM_FileStorage::read(uint32_t offset, void * buffer, size_t len)
+{
+    if (!_file || fseek(_file, offset, SEEK_SET) != 0) {
+        return false;
+    }
+    size_t n = fread(buffer, 1, len, _file);
+    // Beyond the end of the file it is empty storage
+    memset(static_cast<uint8_t *>(buffer) + n, 0xFF, len - n);
+    return true;
+}
+
+bool SIMCOM_FileStorage::write(uint32_t offset, const void * buffer, size_t len)
+{
+    if (!_file || fseek(_file, offset, SEEK_SET) != 0) {
+        return false;
+    }
+    if (fwrite(buffer, 1, len, _file) != len) {
+        return false;
+    }
+    return fflush(_file) == 0;
+}
+
+bool SIMCOM_FileStorage::erase(uint32_t used)
+{
+    (void)used;
+    if (_file) {
+        fclose(_file);
+    }
+    _file = fopen(_path, "w+b");
+    return _file != 0;
+}
+#endif
+
+#if defined(ARDUINO_ARCH_AVR)
+bool SIMCOM_EEPROMStorage::read(uint32_t offset, void * buffer, size_t len)
+{
+    uint8_t * ptr = static_cast<uint8_t *>(buffer);
+    for (size_t i = 0; i < len; ++i) {
+        *ptr++ = EEPROM.read(_start + offset + i);
+    }
+    return true;
+}
+
+bool SIMCOM_EEPROMStorage::write(uint32_t offset, const void * buffer, size_t len)
+{
+    const uint8_t * ptr = static_cast<const uint8_t *>(buffer);
+    for (size_t i = 0; i < len; ++i) {
+        // Only changed bytes are written, this saves EEPROM wear
+        EEPROM.update(_start + offset + i, *ptr++);
+    }
+    return true;
+}
+
+bool SIMCOM_EEPROMStorage::erase(uint32_t used)
+{
+    for (uint32_t i = 0; i < used && i < _size; ++i) {
+        EEPROM.update(_start + i, 0xFF);
+    }
+    return true;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////    SIMCOM_StoreForward     ////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+SIMCOM_StoreForward::SIMCOM_StoreForward(SIMCOM_QueueStorage & storage) :
+    _storage(storage),
+    _head(0),
+    _tail(0),
+    _pending(0),
+    _maxBatchBytes(1024),
+    _separator(0),
+    _rejected(0)
+{
+}
+
+/*
+ * \brief The part of the storage that can hold records
+ */
+uint32_t SIMCOM_StoreForward::room()
+{
+    return _storage.capacity() - (_storage.rewritable() ? SF_JOURNAL_SIZE : 0);
+}
+
+/*
+ * \brief Read the header of a record, and optionally verify the CRC
+ *
+ * Returns false if there is no (valid) record at the offset.
+ * Only begin() needs to verify, after that the records are known good.
+ */
+bool SIMCOM_StoreForward::readHeader(uint32_t offset, uint16_t * len, uint8_t * state, bool verify)
+{
+    uint8_t hdr[SF_HEADER_SIZE];
+    if (offset + SF_HEADER_SIZE > _storage.capacity() ||
+            !_storage.read(offset, hdr, sizeof(hdr)) ||
+            hdr[0] != SF_MAGIC) {
+        return false;
+    }
+    *state = hdr[1];
+    *len = hdr[2] | (hdr[3] << 8);
+    if (offset + SF_HEADER_SIZE + *len > _storage.capacity()) {
+        return false;
+    }
+    if (!verify) {
+        return true;
+    }
+
+    uint16_t crc = crc16(0xFFFF, hdr + 2, 2);
+    uint8_t chunk[SF_CHUNK_SIZE];
+    uint32_t ptr = offset + SF_HEADER_SIZE;
+    size_t todo = *len;
+    while (todo > 0) {
+        size_t n = todo < sizeof(chunk) ? todo : sizeof(chunk);
+        if (!_storage.read(ptr, chunk, n)) {
+            return false;
+        }
+        crc = crc16(crc, chunk, n);
+        ptr += n;
+        todo -= n;
+    }
+    return crc == (uint16_t)(hdr[4] | (hdr[5] << 8));
+}
+
+void SIMCOM_StoreForward::begin()
+{
+    uint32_t offset = 0;
+    uint16_t len;
+    uint8_t state;
+
+    if (_storage.rewritable()) {
+        // Finish a compaction that was interrupted
+        uint8_t journal[SF_JOURNAL_SIZE];
+        if (_storage.read(room(), journal, sizeof(journal)) && journal[0] == SF_JOURNAL_MAGIC) {
+            uint32_t from = journal[1] | ((uint32_t)journal[2] << 8) | ((uint32_t)journal[3] << 16) | ((uint32_t)journal[4] << 24);
+            uint32_t size = journal[5] | ((uint32_t)journal[6] << 8) | ((uint32_t)journal[7] << 16) | ((uint32_t)journal[8] << 24);
+            move(from, size);
+        }
+    }
+
+    _pending = 0;
+    _head = 0;
+    while (readHeader(offset, &len, &state, true)) {
+        if (state == SF_PENDING) {
+            if (_pending == 0) {
+                _head = offset;
+            }
+            ++_pending;
+        }
+        offset += SF_HEADER_SIZE + len;
+    }
+    _tail = offset;
+
+    if (_pending == 0 && _tail > 0) {
+        // Everything was sent. Start with empty storage.
+        _storage.erase(_tail);
+        _tail = 0;
+    }
+}
+
+bool SIMCOM_StoreForward::push(const void * data, size_t len)
+{
+    if (_tail + SF_HEADER_SIZE + len > room() && canCompact()) {
+        compact();
+    }
+    if (len > 0xFFFF || _tail + SF_HEADER_SIZE + len > room()) {
+        return false;
+    }
+
+    uint8_t hdr[SF_HEADER_SIZE];
+    hdr[0] = SF_MAGIC;
+    hdr[1] = SF_PENDING;
+    hdr[2] = len;
+    hdr[3] = len >> 8;
+    uint16_t crc = crc16(0xFFFF, hdr + 2, 2);
+    crc = crc16(crc, static_cast<const uint8_t *>(data), len);
+    hdr[4] = crc;
+    hdr[5] = crc >> 8;
+
+    // First the data and the rest of the header, the magic goes last.
+    // After a compaction there are old bytes after it, end the records.
+    uint32_t end = _tail + SF_HEADER_SIZE + len;
+    const uint8_t empty = 0xFF;
+    if (!_storage.write(_tail + SF_HEADER_SIZE, data, len) ||
+            !_storage.write(_tail + 1, hdr + 1, SF_HEADER_SIZE - 1) ||
+            (_storage.rewritable() && end < room() && !_storage.write(end, &empty, 1)) ||
+            !_storage.write(_tail, hdr, 1)) {
+        return false;
+    }
+
+    if (_pending == 0) {
+        _head = _tail;
+    }
+    ++_pending;
+    _tail += SF_HEADER_SIZE + len;
+    return true;
+}
+
+int32_t SIMCOM_StoreForward::peek(uint8_t * buffer, size_t buflen)
+{
+    uint16_t len;
+    uint8_t state;
+    if (_pending == 0 || !readHeader(_head, &len, &state)) {
+        return -1;
+    }
+    if (buflen > len) {
+        buflen = len;
+    }
+    if (!_storage.read(_head + SF_HEADER_SIZE, buffer, buflen)) {
+        return -1;
+    }
+    return len;
+}
+
+void SIMCOM_StoreForward::pop(size_t nr)
+{
+    uint16_t len;
+    uint8_t state;
+    const uint8_t sent = SF_SENT;
+
+    while (nr-- > 0 && _pending > 0) {
+        if (!readHeader(_head, &len, &state)) {
+            break;
+        }
+        _storage.write(_head + 1, &sent, 1);
+        _head += SF_HEADER_SIZE + len;
+        --_pending;
+    }
+
+    if (_pending == 0) {
+        _storage.erase(_tail);
+        _head = 0;
+        _tail = 0;
+    } else if (canCompact() && _tail > room() / 2) {
+        compact();
+    }
+}
+
+/*
+ * \brief Can the pending records be moved to the start of the storage?
+ *
+ * Only if they don't overlap with where they go, so that the move can
+ * be done again after a power loss.
+ */
+bool SIMCOM_StoreForward::canCompact()
+{
+    return _storage.rewritable() && _pending > 0 && _tail - _head <= _head;
+}
+
+/*
+ * \brief Move the pending records to the start of the storage
+ */
+void SIMCOM_StoreForward::compact()
+{
+    uint32_t size = _tail - _head;
+    uint8_t journal[SF_JOURNAL_SIZE];
+    journal[0] = SF_JOURNAL_MAGIC;
+    for (uint8_t i = 0; i < 4; ++i) {
+        journal[1 + i] = _head >> (8 * i);
+        journal[5 + i] = size >> (8 * i);
+    }
+    if (!_storage.write(room() + 1, journal + 1, SF_JOURNAL_SIZE - 1) ||
+            !_storage.write(room(), journal, 1)) {
+        return;
+    }
+    move(_head, size);
+    _head = 0;
+    _tail = size;
+}
+
+/*
+ * \brief Copy <size> bytes from <from> to the start, and end the records there
+ *
+ * This is done again by begin() if it was interrupted.
+ */
+void SIMCOM_StoreForward::move(uint32_t from, uint32_t size)
+{
+    uint8_t chunk[SF_CHUNK_SIZE];
+    const uint8_t empty = 0xFF;
+    for (uint32_t done = 0; done < size; ) {
+        size_t n = size - done < sizeof(chunk) ? size - done : sizeof(chunk);
+        _storage.read(from + done, chunk, n);
+        _storage.write(done, chunk, n);
+        done += n;
+    }
+    if (size < room()) {
+        _storage.write(size, &empty, 1);
+    }
+    _storage.write(room(), &empty, 1);
+}
+
+/*
+ * \brief Compute the number of records for the next batch
+ *
+ * There is at least one record in a batch (if there is one pending).
+ */
+size_t SIMCOM_StoreForward::batchSize()
+{
+    uint32_t offset = _head;
+    size_t bytes = 0;
+    size_t nr = 0;
+    uint16_t len;
+    uint8_t state;
+
+    while (nr < _pending && readHeader(offset, &len, &state)) {
+        bytes += len + (_separator ? 1 : 0);
+        if (nr > 0 && bytes > _maxBatchBytes) {
+            break;
+        }
+        ++nr;
+        offset += SF_HEADER_SIZE + len;
+    }
+    return nr;
+}
+
+/*
+ * \brief Did the server reject the content of the request?
+ *
+ * Only then a record is dropped. Other errors, even permanent ones like
+ * 404, can be caused by the configuration and say nothing about the
+ * records.
+ */
+bool SIMCOM_StoreForward::isContentRejected(int status)
+{
+    return status == 400 || status == 413 || status == 415 || status == 422;
+}
+
+bool SIMCOM_StoreForward::uploadHTTP(SIMx00 & modem, const char * url, const char * contentType, const char * userdata)
+{
+    // After a rejection the batches are smaller, until the record that
+    // is the cause is found. 0 is no limit.
+    size_t limit = 0;
+    while (_pending > 0) {
+        size_t nr = batchSize();
+        if (nr == 0) {
+            // The storage is corrupt
+            return false;
+        }
+        if (limit > 0 && nr > limit) {
+            nr = limit;
+        }
+        SIMCOM_QueueBody body(*this, nr);
+        int status = 0;
+        if (!modem.doHTTPPOSTmiddle(url, contentType, userdata, body, &status)) {
+            return false;
+        }
+        if (status >= 200 && status < 300) {
+            pop(nr);
+        } else if (!isContentRejected(status)) {
+            // E.g. a server error, or a wrong URL or credentials (401, 404).
+            // Keep the records and try again later.
+            return false;
+        } else if (nr > 1) {
+            limit = nr / 2;
+        } else {
+            // Sending it again will not help
+            pop(1);
+            ++_rejected;
+            limit = 0;
+        }
+    }
+    return true;
+}
+
+bool SIMCOM_StoreForward::uploadTCP(SIMx00 & modem)
+{
+    while (_pending > 0) {
+        size_t nr = batchSize();
+        if (nr == 0) {
+            return false;
+        }
+        SIMCOM_QueueBody body(*this, nr);
+        if (!modem.sendDataTCP(body)) {
+            return false;
+        }
+        pop(nr);
+    }
+    return true;
+}
+
+bool SIMCOM_StoreForward::postHTTP(SIMx00 & modem, const char * apn, const char * url,
+        const char * contentType, const char * userdata, const void * data, size_t len)
+{
+    bool retval = false;
+    // If the queue is full we first try to make room
+    bool stored = !data || push(data, len);
+
+    if (!modem.on()) {
+        goto ending;
+    }
+    if (!modem.doHTTPprolog(apn)) {
+        goto ending;
+    }
+    retval = uploadHTTP(modem, url, contentType, userdata);
+    if (retval && !stored) {
+        stored = push(data, len);
+        retval = stored && uploadHTTP(modem, url, contentType, userdata);
+    }
+    modem.doHTTPepilog();
+
+ending:
+    modem.offOrSleep(retval);
+    return retval;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////    SIMCOM_QueueBody        ////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+void SIMCOM_QueueBody::render(Print & out)
+{
+    uint32_t offset = _queue._head;
+    uint16_t len;
+    uint8_t state;
+    uint8_t chunk[SF_CHUNK_SIZE];
+
+    for (size_t i = 0; i < _nr; ++i) {
+        if (!_queue.readHeader(offset, &len, &state)) {
+            break;
+        }
+        uint32_t ptr = offset + SF_HEADER_SIZE;
+        size_t todo = len;
+        while (todo > 0) {
+            size_t n = todo < sizeof(chunk) ? todo : sizeof(chunk);
+            _queue._storage.read(ptr, chunk, n);
+            out.write(chunk, n);
+            ptr += n;
+            todo -= n;
+        }
+        if (_queue._separator) {
+            out.write((uint8_t)_queue._separator);
+        }
+        offset += SF_HEADER_SIZE + len;
+    }
+}
+
+size_t SIMCOM_QueueBody::length()
+{
+    uint32_t offset = _queue._head;
+    uint16_t len;
+    uint8_t state;
+    size_t total = 0;
+
+    for (size_t i = 0; i < _nr; ++i) {
+        if (!_queue.readHeader(offset, &len, &state)) {
+            break;
+        }
+        total += len + (_queue._separator ? 1 : 0);
+        offset += SF_HEADER_SIZE + len;
+    }
+    return total;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_STOREFORWARD_h
+#define _SIMCOM_STOREFORWARD_h
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "SIMCOM_Body.h"
+#include "SIMx00.h"
+
+#ifndef ARDUINO
+#include <stdio.h>
+#endif
+
+/*!
+ * \brief The storage that holds the store-and-forward queue
+ *
+ * It's a pure virtual class, so you'll have to implement a specialized
+ * class for your storage (EEPROM, flash, SD card, ...).
+ * Empty (erased) storage must read as 0xFF.
+ */
+class SIMCOM_QueueStorage
+{
+public:
+    virtual ~SIMCOM_QueueStorage() {}
+    virtual uint32_t capacity() = 0;
+    virtual bool read(uint32_t offset, void * buffer, size_t len) = 0;
+    virtual bool write(uint32_t offset, const void * buffer, size_t len) = 0;
+    // Make the first <used> bytes empty again.
+    virtual bool erase(uint32_t used) = 0;
+    // Can bytes be written that are not empty? E.g. EEPROM can, flash can't.
+    // If so the queue is compacted while it drains.
+    virtual bool rewritable() { return false; }
+};
+
+#ifndef ARDUINO
+/*!
+ * \brief Queue storage in a file, for host builds
+ */
+class SIMCOM_FileStorage : public SIMCOM_QueueStorage
+{
+public:
+    SIMCOM_FileStorage(const char * path, uint32_t capacity);
+    ~SIMCOM_FileStorage();
+    uint32_t capacity() { return _capacity; }
+    bool read(uint32_t offset, void * buffer, size_t len);
+    bool write(uint32_t offset, const void * buffer, size_t len);
+    bool erase(uint32_t used);
+    bool rewritable() { return true; }
+
+private:
+    const char * _path;
+    uint32_t _capacity;
+    FILE * _file;
+};
+#endif
+
+#if defined(ARDUINO_ARCH_AVR)
+/*!
+ * \brief Queue storage in (a part of) the AVR EEPROM
+ */
+class SIMCOM_EEPROMStorage : public SIMCOM_QueueStorage
+{
+public:
+    SIMCOM_EEPROMStorage(uint16_t start, uint16_t size) : _start(start), _size(size) {}
+    uint32_t capacity() { return _size; }
+    bool read(uint32_t offset, void * buffer, size_t len);
+    bool write(uint32_t offset, const void * buffer, size_t len);
+    bool erase(uint32_t used);
+    bool rewritable() { return true; }
+
+private:
+    uint16_t _start;
+    uint16_t _size;
+};
+#endif
+
+/*!
+ * \brief A persistent queue of upload records
+ *
+ * Records are appended to the storage with a small header that has
+ * a CRC. A record is marked as sent by clearing its state byte, so
+ * storage is only rewritten when the whole queue has been drained.
+ * A record that was not completely written (e.g. power loss) is
+ * ignored when the queue is scanned with begin().
+ *
+ * The pending records are uploaded in batches, each batch is one
+ * HTTP POST (or TCP send) with the records back to back. A batch whose
+ * content the server rejects (400, 413, 415 or 422) is split until the
+ * record that is the cause is found, that record is dropped. With any
+ * other error the records are kept, e.g. a wrong URL (404) must not
+ * empty the queue.
+ *
+ * If the storage is rewritable the pending records are moved to the
+ * start when there are more sent records before them than the size of
+ * the pending records, and the storage is half full (or full). A small
+ * journal at the end of the storage makes the move safe against a
+ * power loss.
+ */
+class SIMCOM_StoreForward
+{
+public:
+    SIMCOM_StoreForward(SIMCOM_QueueStorage & storage);
+
+    // Scan the storage. Must be called once before anything else.
+    void begin();
+
+    // Append a record. Returns false if there is no room.
+    bool push(const void * data, size_t len);
+
+    // Returns the number of records that are not yet sent.
+    size_t pending() const { return _pending; }
+    bool isEmpty() const { return _pending == 0; }
+
+    // Copy the first pending record. Returns its length, or -1.
+    int32_t peek(uint8_t * buffer, size_t buflen);
+
+    // Mark the first <nr> pending records as sent.
+    void pop(size_t nr = 1);
+
+    // Limit the size of one batch. Each record is followed by the
+    // separator, unless it is 0 (e.g. '\n' for JSON lines).
+    void setBatchLimit(size_t maxBytes, char separator = 0) { _maxBatchBytes = maxBytes; _separator = separator; }
+
+    // Upload all pending records with HTTP POST. The HTTP session
+    // must already be set up (see doHTTPprolog).
+    bool uploadHTTP(SIMx00 & modem, const char * url, const char * contentType, const char * userdata);
+
+    // The number of records that were dropped because the server rejected them
+    uint32_t rejected() const { return _rejected; }
+
+    // Upload all pending records over an open TCP connection.
+    bool uploadTCP(SIMx00 & modem);
+
+    // Store the data, then switch on the modem and upload everything
+    // that is pending (including this). The data survives a failure.
+    bool postHTTP(SIMx00 & modem, const char * apn, const char * url,
+            const char * contentType, const char * userdata, const void * data, size_t len);
+
+private:
+    friend class SIMCOM_QueueBody;
+
+    bool readHeader(uint32_t offset, uint16_t * len, uint8_t * state, bool verify = false);
+    size_t batchSize();
+    static bool isContentRejected(int status);
+    uint32_t room();
+    bool canCompact();
+    void compact();
+    void move(uint32_t from, uint32_t size);
+
+    SIMCOM_QueueStorage & _storage;
+    uint32_t _head;             // offset of the first pending record
+    uint32_t _tail;             // offset where the next record goes
+    size_t _pending;
+    size_t _maxBatchBytes;
+    char _separator;
+    uint32_t _rejected;
+};
+
+/*!
+ * \brief A body with the first <nr> pending records of the queue
+ */
+class SIMCOM_QueueBody : public SIMCOM_BodyProducer
+{
+public:
+    SIMCOM_QueueBody(SIMCOM_StoreForward & queue, size_t nr) : _queue(queue), _nr(nr) {}
+    void render(Print & out);
+    size_t length();
+
+private:
+    SIMCOM_StoreForward & _queue;
+    size_t _nr;
+};
+
+#endif
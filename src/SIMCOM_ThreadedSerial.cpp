@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef ARDUINO
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "SIMCOM_ThreadedSerial.h"
+
+static uint64_t nowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool openPipe(int fds[2])
+{
+    if (pipe(fds) != 0) {
+        fds[0] = fds[1] = -1;
+        return false;
+    }
+    for (int i = 0; i < 2; ++i) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    return true;
+}
+
+static void closePipe(int fds[2])
+{
+    for (int i = 0; i < 2; ++i) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+}
+
+static void drainPipe(int fd)
+{
+    char buf[64];
+    while (::read(fd, buf, sizeof(buf)) > 0) {
+    }
+}
+
+SIMCOM_ThreadedSerial::SIMCOM_ThreadedSerial(int fd) :
+    _fd(fd),
+    _stopping(false),
+    _sleeping(false),
+    _received(0),
+    _hangupUntil(0),
+    _consumed(0),
+    _lineCount(0),
+    _maxLineLatency(0),
+    _totalLineLatency(0)
+{
+    _wakeup[0] = _wakeup[1] = -1;
+    _rxEvent[0] = _rxEvent[1] = -1;
+}
+
+SIMCOM_ThreadedSerial::~SIMCOM_ThreadedSerial()
+{
+    stop();
+}
+
+bool SIMCOM_ThreadedSerial::start()
+{
+    if (_thread.joinable()) {
+        return true;
+    }
+    if (!openPipe(_wakeup) || !openPipe(_rxEvent)) {
+        closePipe(_wakeup);
+        closePipe(_rxEvent);
+        return false;
+    }
+    _stopping = false;
+    _thread = std::thread(&SIMCOM_ThreadedSerial::run, this);
+    return true;
+}
+
+void SIMCOM_ThreadedSerial::stop()
+{
+    if (!_thread.joinable()) {
+        return;
+    }
+    _stopping = true;
+    wake();
+    _thread.join();
+    closePipe(_wakeup);
+    closePipe(_rxEvent);
+}
+
+void SIMCOM_ThreadedSerial::wake()
+{
+    char c = 0;
+    if (_wakeup[1] >= 0) {
+        (void)::write(_wakeup[1], &c, 1);
+    }
+}
+
+/*
+ * \brief The I/O thread
+ */
+void SIMCOM_ThreadedSerial::run()
+{
+    while (!_stopping) {
+        struct pollfd fds[2];
+        // When the input queue is full, look again after a while
+        bool input = _rx.room() > 0;
+        int timeout = input ? -1 : 10;
+        // After a hangup, leave the port out until _hangupUntil
+        if (_hangupUntil) {
+            uint64_t now = nowMicros();
+            if (now < _hangupUntil) {
+                int left = (_hangupUntil - now + 999) / 1000;
+                if (input || left < timeout) {
+                    timeout = left;
+                }
+                input = false;
+            } else {
+                _hangupUntil = 0;
+            }
+        }
+        // Tell write() to wake us, then look again if there is output.
+        // The fence pairs with the one in write(): either we see the
+        // output, or write() sees _sleeping.
+        _sleeping = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!_tx.empty()) {
+            timeout = 0;
+        }
+        // poll() skips a negative fd, so there is no POLLHUP either
+        fds[0].fd = input ? _fd : -1;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = _wakeup[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        int nr = ::poll(fds, 2, timeout);
+        _sleeping = false;
+        if (nr < 0 && errno != EINTR) {
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            drainPipe(_wakeup[0]);
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            readInput();
+        }
+        if (!_tx.empty()) {
+            writeOutput();
+        }
+    }
+}
+
+void SIMCOM_ThreadedSerial::readInput()
+{
+    uint8_t buf[512];
+    size_t room = _rx.room();
+    if (room == 0) {
+        return;
+    }
+    ssize_t nr = ::read(_fd, buf, room < sizeof(buf) ? room : sizeof(buf));
+    if (nr <= 0) {
+        if (nr == 0 || (errno != EAGAIN && errno != EINTR)) {
+            // The other side is gone. Leave the port out of the poll set
+            // for a while, output and wake() still go on.
+            _hangupUntil = nowMicros() + SIMCOM_THREADED_HANGUP_MS * 1000;
+        }
+        return;
+    }
+    // The line ends go first, so a line is complete when the application
+    // has all its bytes. There is room, every queued mark has a queued byte.
+    uint64_t now = nowMicros();
+    for (ssize_t i = 0; i < nr; ++i) {
+        if (buf[i] == '\n') {
+            LineMark mark = { _received + i + 1, now };
+            _lineMarks.push(mark);
+        }
+    }
+    _rx.push(buf, nr);
+    _received += nr;
+
+    char c = 0;
+    (void)::write(_rxEvent[1], &c, 1);
+}
+
+void SIMCOM_ThreadedSerial::writeOutput()
+{
+    while (!_tx.empty()) {
+        const uint8_t * first;
+        size_t nr = _tx.contiguous(&first);
+        ssize_t done = ::write(_fd, first, nr);
+        if (done <= 0) {
+            if (done < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                // Wait until the port takes more
+                struct pollfd pfd = { _fd, POLLOUT, 0 };
+                ::poll(&pfd, 1, 100);
+            } else if (done < 0 && errno != EINTR) {
+                // Nobody is listening, drop it like a serial line would
+                _tx.drop(nr);
+                continue;
+            }
+            return;
+        }
+        _tx.drop(done);
+    }
+}
+
+bool SIMCOM_ThreadedSerial::waitForInput(int timeout)
+{
+    if (!_rx.empty()) {
+        return true;
+    }
+    struct pollfd pfd = { _rxEvent[0], POLLIN, 0 };
+    if (::poll(&pfd, 1, timeout) > 0) {
+        drainPipe(_rxEvent[0]);
+    }
+    return !_rx.empty();
+}
+
+bool SIMCOM_ThreadedSerial::waitForLine(int timeout)
+{
+    if (hasLine()) {
+        return true;
+    }
+    struct pollfd pfd = { _rxEvent[0], POLLIN, 0 };
+    if (::poll(&pfd, 1, timeout) > 0) {
+        drainPipe(_rxEvent[0]);
+    }
+    return hasLine();
+}
+
+bool SIMCOM_ThreadedSerial::hasLine() const
+{
+    const LineMark * mark = _lineMarks.front();
+    return mark && _rx.size() >= mark->end - _consumed;
+}
+
+/*
+ * \brief Copy the first line, split by the I/O thread
+ */
+int SIMCOM_ThreadedSerial::readLine(char * buffer, size_t size)
+{
+    if (!hasLine()) {
+        return -1;
+    }
+    size_t left = _lineMarks.front()->end - _consumed;
+    size_t len = 0;
+    while (left > 0) {
+        const uint8_t * first;
+        size_t nr = _rx.contiguous(&first);
+        if (nr > left) {
+            nr = left;
+        }
+        size_t copy = size - 1 - len;
+        if (copy > nr) {
+            copy = nr;
+        }
+        memcpy(buffer + len, first, copy);
+        len += copy;
+        _rx.drop(nr);
+        left -= nr;
+    }
+    while (len > 0 && (buffer[len - 1] == '\n' || buffer[len - 1] == '\r')) {
+        --len;
+    }
+    buffer[len] = 0;
+    _consumed = _lineMarks.front()->end;
+    lineRead();
+    return len;
+}
+
+void SIMCOM_ThreadedSerial::lineRead()
+{
+    uint32_t latency = nowMicros() - _lineMarks.front()->time;
+    ++_lineCount;
+    _totalLineLatency += latency;
+    if (latency > _maxLineLatency) {
+        _maxLineLatency = latency;
+    }
+    _lineMarks.drop(1);
+}
+
+int SIMCOM_ThreadedSerial::available()
+{
+    return _rx.size();
+}
+
+int SIMCOM_ThreadedSerial::peek()
+{
+    const uint8_t * c = _rx.front();
+    return c ? *c : -1;
+}
+
+int SIMCOM_ThreadedSerial::read()
+{
+    uint8_t c;
+    if (!_rx.pop(c)) {
+        return -1;
+    }
+    ++_consumed;
+    const LineMark * mark = _lineMarks.front();
+    if (mark && mark->end == _consumed) {
+        lineRead();
+    }
+    return c;
+}
+
+size_t SIMCOM_ThreadedSerial::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t SIMCOM_ThreadedSerial::write(const uint8_t * buffer, size_t size)
+{
+    size_t done = 0;
+    while (done < size) {
+        size_t nr = _tx.push(buffer + done, size - done);
+        done += nr;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_sleeping) {
+            wake();
+        }
+        if (done < size) {
+            if (!_thread.joinable()) {
+                break;
+            }
+            // Full, let the I/O thread catch up
+            std::this_thread::yield();
+        }
+    }
+    return done;
+}
+
+void SIMCOM_ThreadedSerial::flush()
+{
+    while (!_tx.empty() && _thread.joinable()) {
+        std::this_thread::yield();
+    }
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_THREADEDSERIAL_h
+#define _SIMCOM_THREADEDSERIAL_h
+
+#ifndef ARDUINO
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <Stream.h>
+#include "SIMCOM_SpscQueue.h"
+#include "SIMCOM_LineSource.h"
+
+#define SIMCOM_THREADED_RX_SIZE         4096
+#define SIMCOM_THREADED_TX_SIZE         1024
+// Every input byte can be a line end, so the line queue never overflows
+#define SIMCOM_THREADED_LINES           SIMCOM_THREADED_RX_SIZE
+// After a hangup the port is left out of the poll set for this long (ms)
+#define SIMCOM_THREADED_HANGUP_MS       100
+
+/*!
+ * \brief A Stream with an I/O thread that owns the file descriptor
+ *
+ * The thread reads from the serial port (see SIMCOM_PosixSerial) as
+ * soon as there is input, and writes what the application wrote. The
+ * bytes go through lock-free SPSC queues, so the application thread
+ * never does a system call to read or write the modem.
+ *   SIMCOM_PosixSerial serial;
+ *   serial.open("/dev/ttyUSB0", 115200);
+ *   SIMCOM_ThreadedSerial io(serial.fd());
+ *   io.start();
+ *   modem.init(io, onoff);
+ * The application can wait for input with waitForInput(), or put
+ * eventFd() in its epoll set.
+ *
+ * The I/O thread also splits the input in lines. With
+ *   modem.setLineSource(&io);
+ * the modem code takes whole lines from the line queue, see readLine().
+ * Prompts and binary data are still read byte by byte.
+ *
+ * The time from the I/O thread seeing the end of a line until the
+ * application reads it is measured, see maxLineLatency().
+ */
+class SIMCOM_ThreadedSerial : public Stream, public SIMCOM_LineSource {
+public:
+    // The file descriptor stays owned by the caller
+    SIMCOM_ThreadedSerial(int fd);
+    ~SIMCOM_ThreadedSerial();
+
+    bool start();
+    void stop();
+
+    // Wait (at most timeout ms) until there is something to read
+    bool waitForInput(int timeout);
+    // Readable when the I/O thread added input
+    int eventFd() const { return _rxEvent[0]; }
+
+    int available();
+    int peek();
+    int read();
+    // The next line, see SIMCOM_LineSource
+    int readLine(char * buffer, size_t size);
+    bool waitForLine(int timeout);
+
+    size_t write(uint8_t c);
+    size_t write(const uint8_t * buffer, size_t size);
+    using Print::write;
+    // Waits until the I/O thread wrote everything
+    void flush();
+
+    // Line delivery latency in us
+    uint32_t lineCount() const { return _lineCount; }
+    uint32_t maxLineLatency() const { return _maxLineLatency; }
+    uint32_t avgLineLatency() const { return _lineCount ? _totalLineLatency / _lineCount : 0; }
+    void clearLineLatency() { _lineCount = 0; _maxLineLatency = 0; _totalLineLatency = 0; }
+
+private:
+    struct LineMark {
+        size_t end;             // the input count after the line end
+        uint64_t time;          // when the I/O thread read it (us)
+    };
+    void run();
+    void wake();
+    void readInput();
+    void writeOutput();
+    bool hasLine() const;
+    // The application took the first line
+    void lineRead();
+
+    int _fd;
+    int _wakeup[2];             // a pipe, to wake the I/O thread
+    int _rxEvent[2];            // a pipe, to tell the application there is input
+    std::thread _thread;
+    std::atomic<bool> _stopping;
+    std::atomic<bool> _sleeping;        // the I/O thread waits without POLLOUT
+    SIMCOM_SpscQueue<uint8_t, SIMCOM_THREADED_RX_SIZE> _rx;
+    SIMCOM_SpscQueue<uint8_t, SIMCOM_THREADED_TX_SIZE> _tx;
+    SIMCOM_SpscQueue<LineMark, SIMCOM_THREADED_LINES> _lineMarks;
+    // Only used by the I/O thread
+    size_t _received;
+    uint64_t _hangupUntil;      // the port hung up, don't poll it until then (us)
+
+    // Only used by the application thread
+    size_t _consumed;
+    uint32_t _lineCount;
+    uint32_t _maxLineLatency;
+    uint64_t _totalLineLatency;
+};
+
+#endif
+
+#endif
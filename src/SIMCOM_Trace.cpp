@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#include "SIMCOM_Trace.h"
+
+// The tracks (thread ids) in the JSON
+#define TRACK_COMMAND   1
+#define TRACK_SLEEP     2
+#define TRACK_POWER     3
+
+SIMCOM_TraceRing::SIMCOM_TraceRing(SIMCOM_TraceEvent * buffer, size_t size) :
+    _buffer(buffer),
+    _size(size)
+{
+    clear();
+}
+
+void SIMCOM_TraceRing::clear()
+{
+    _head = 0;
+    _count = 0;
+    _dropped = 0;
+}
+
+void SIMCOM_TraceRing::add(uint8_t type, uint8_t cmd, uint16_t arg)
+{
+    add(micros(), type, cmd, arg);
+}
+
+void SIMCOM_TraceRing::add(uint32_t ts, uint8_t type, uint8_t cmd, uint16_t arg)
+{
+    if (_size == 0) {
+        return;
+    }
+    SIMCOM_TraceEvent & event = _buffer[_head];
+    event.ts = ts;
+    event.type = type;
+    event.cmd = cmd;
+    event.arg = arg;
+    if (++_head >= _size) {
+        _head = 0;
+    }
+    if (_count < _size) {
+        ++_count;
+    } else {
+        ++_dropped;
+    }
+}
+
+const SIMCOM_TraceEvent & SIMCOM_TraceRing::get(size_t ix) const
+{
+    size_t pos = _head + _size - _count + ix;
+    if (pos >= _size) {
+        pos -= _size;
+    }
+    return _buffer[pos];
+}
+
+void SIMCOM_TraceRing::writeBinary(Print & out) const
+{
+    for (size_t i = 0; i < _count; ++i) {
+        const SIMCOM_TraceEvent & event = get(i);
+        uint8_t record[SIMCOM_TRACE_RECORD_SIZE];
+        record[0] = event.ts;
+        record[1] = event.ts >> 8;
+        record[2] = event.ts >> 16;
+        record[3] = event.ts >> 24;
+        record[4] = event.type;
+        record[5] = event.cmd;
+        record[6] = event.arg;
+        record[7] = event.arg >> 8;
+        out.write(record, sizeof(record));
+    }
+}
+
+void SIMCOM_TraceRing::writeChromeJSON(Print & out) const
+{
+    SIMCOM_ChromeTraceWriter writer(out);
+    writer.begin();
+    for (size_t i = 0; i < _count; ++i) {
+        writer.add(get(i));
+    }
+    writer.end();
+}
+
+SIMCOM_ChromeTraceWriter::SIMCOM_ChromeTraceWriter(Print & out) :
+    _out(out),
+    _first(true),
+    _started(false),
+    _lastTs(0),
+    _time(0),
+    _inCommand(false),
+    _command(SIMCOM_CMD_OTHER),
+    _commandStart(0),
+    _commandLast(0),
+    _sleepStart(0),
+    _powerStart(0),
+    _powerOn(false)
+{
+}
+
+void SIMCOM_ChromeTraceWriter::decode(const uint8_t * record, SIMCOM_TraceEvent * event)
+{
+    event->ts = (uint32_t)record[0] | ((uint32_t)record[1] << 8) | ((uint32_t)record[2] << 16) | ((uint32_t)record[3] << 24);
+    event->type = record[4];
+    event->cmd = record[5];
+    event->arg = record[6] | (record[7] << 8);
+}
+
+void SIMCOM_ChromeTraceWriter::begin()
+{
+    _out.print(F("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    _first = true;
+    // Give the tracks a name
+    static const char trackNames[][9] PROGMEM = { "commands", "sleep", "power" };
+    for (uint8_t i = 0; i < sizeof(trackNames) / sizeof(trackNames[0]); ++i) {
+        if (!_first) {
+            _out.print(',');
+        }
+        _first = false;
+        _out.print(F("\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"));
+        _out.print(i + 1);
+        _out.print(F(",\"args\":{\"name\":"));
+        writeName(trackNames[i]);
+        _out.print(F("}}"));
+    }
+}
+
+void SIMCOM_ChromeTraceWriter::end()
+{
+    closeCommand();
+    _out.print(F("\n]}\n"));
+}
+
+void SIMCOM_ChromeTraceWriter::add(const SIMCOM_TraceEvent & event)
+{
+    // micros() wraps around after about 71 minutes, the deltas don't
+    if (_started) {
+        _time += (uint32_t)(event.ts - _lastTs);
+    }
+    _started = true;
+    _lastTs = event.ts;
+
+    switch (event.type) {
+    case SIMCOM_TRACE_COMMAND:
+        closeCommand();
+        _inCommand = true;
+        _command = event.cmd;
+        _commandStart = _time;
+        _commandLast = _time;
+        break;
+    case SIMCOM_TRACE_FIRST_RX:
+        writeInstant(TRACK_COMMAND, PSTR("first byte"), _time);
+        break;
+    case SIMCOM_TRACE_RESULT:
+        {
+            static const char results[][8] PROGMEM = { "none", "OK", "ERROR", "TIMEOUT" };
+            uint8_t ix = event.arg < sizeof(results) / sizeof(results[0]) ? event.arg : 0;
+            writeInstant(TRACK_COMMAND, PSTR("reply"), _time, results[ix]);
+            _commandLast = _time;
+        }
+        break;
+    case SIMCOM_TRACE_URC:
+        writeInstant(TRACK_COMMAND, SIMCOM_commandName(event.cmd), _time);
+        break;
+    case SIMCOM_TRACE_SLEEP_BEGIN:
+        _sleepStart = _time;
+        break;
+    case SIMCOM_TRACE_SLEEP_END:
+        writeSpan(TRACK_SLEEP, PSTR("sleep"), _sleepStart, _time);
+        break;
+    case SIMCOM_TRACE_POWER_ON:
+    case SIMCOM_TRACE_POWER_OFF:
+        _powerStart = _time;
+        _powerOn = event.type == SIMCOM_TRACE_POWER_ON;
+        break;
+    case SIMCOM_TRACE_POWER_ON_END:
+    case SIMCOM_TRACE_POWER_OFF_END:
+        writeSpan(TRACK_POWER, _powerOn ? PSTR("on") : PSTR("off"), _powerStart, _time);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * \brief Write the span of the current command, until its last reply
+ */
+void SIMCOM_ChromeTraceWriter::closeCommand()
+{
+    if (_inCommand) {
+        writeSpan(TRACK_COMMAND, SIMCOM_commandName(_command), _commandStart, _commandLast);
+        _inCommand = false;
+    }
+}
+
+void SIMCOM_ChromeTraceWriter::writeHead(const __FlashStringHelper * phase, uint8_t track, uint64_t ts)
+{
+    if (!_first) {
+        _out.print(',');
+    }
+    _first = false;
+    _out.print(F("\n{\"ph\":\""));
+    _out.print(phase);
+    _out.print(F("\",\"pid\":1,\"tid\":"));
+    _out.print(track);
+    _out.print(F(",\"ts\":"));
+    writeTime(ts);
+}
+
+// Write a (PROGMEM) name as a JSON string
+void SIMCOM_ChromeTraceWriter::writeName(const char * name)
+{
+    _out.print('"');
+    _out.print(reinterpret_cast<const __FlashStringHelper *>(name));
+    _out.print('"');
+}
+
+void SIMCOM_ChromeTraceWriter::writeSpan(uint8_t track, const char * name, uint64_t start, uint64_t end)
+{
+    writeHead(F("X"), track, start);
+    _out.print(F(",\"dur\":"));
+    writeTime(end - start);
+    _out.print(F(",\"name\":"));
+    writeName(name);
+    _out.print('}');
+}
+
+void SIMCOM_ChromeTraceWriter::writeInstant(uint8_t track, const char * name, uint64_t ts, const char * result)
+{
+    writeHead(F("i"), track, ts);
+    _out.print(F(",\"s\":\"t\",\"name\":"));
+    writeName(name);
+    if (result) {
+        _out.print(F(",\"args\":{\"result\":"));
+        writeName(result);
+        _out.print('}');
+    }
+    _out.print('}');
+}
+
+// Print can't do 64 bits
+void SIMCOM_ChromeTraceWriter::writeTime(uint64_t us)
+{
+    char buf[21];
+    char * ptr = &buf[sizeof(buf) - 1];
+    *ptr = '\0';
+    do {
+        *--ptr = '0' + (us % 10);
+        us /= 10;
+    } while (us > 0);
+    _out.print(ptr);
+}
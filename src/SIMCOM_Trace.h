@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_TRACE_h
+#define _SIMCOM_TRACE_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Print.h>
+#include "SIMCOM_Commands.h"
+
+// The size of one event in the binary dump
+#define SIMCOM_TRACE_RECORD_SIZE        8
+
+enum SIMCOM_TraceType {
+    SIMCOM_TRACE_COMMAND,       // command sent, cmd is the SIMCOM_CommandId
+    SIMCOM_TRACE_FIRST_RX,      // the first byte after the command was received
+    SIMCOM_TRACE_RESULT,        // a reply, arg is the SIMCOM_ReplyResult
+    SIMCOM_TRACE_URC,           // an other line, cmd is the SIMCOM_CommandId of its prefix
+    SIMCOM_TRACE_SLEEP_BEGIN,   // mydelay(), arg is the delay in ms
+    SIMCOM_TRACE_SLEEP_END,
+    SIMCOM_TRACE_POWER_ON,      // on() started
+    SIMCOM_TRACE_POWER_ON_END,  // arg is 1 if successful
+    SIMCOM_TRACE_POWER_OFF,
+    SIMCOM_TRACE_POWER_OFF_END,
+};
+
+/*!
+ * \brief One trace event
+ */
+struct SIMCOM_TraceEvent {
+    uint32_t ts;                // micros()
+    uint8_t type;               // SIMCOM_TraceType
+    uint8_t cmd;                // SIMCOM_CommandId
+    uint16_t arg;
+};
+
+/*!
+ * \brief A ring of trace events in a fixed buffer
+ *
+ * When the ring is full the oldest events are overwritten.
+ */
+class SIMCOM_TraceRing {
+public:
+    SIMCOM_TraceRing(SIMCOM_TraceEvent * buffer, size_t size);
+
+    void clear();
+    void add(uint8_t type, uint8_t cmd, uint16_t arg = 0);
+    void add(uint32_t ts, uint8_t type, uint8_t cmd, uint16_t arg);
+
+    // The number of events in the ring
+    size_t count() const { return _count; }
+    // The number of events that were overwritten
+    uint32_t dropped() const { return _dropped; }
+    // Returns event <ix>, 0 is the oldest
+    const SIMCOM_TraceEvent & get(size_t ix) const;
+
+    // Write the events as little endian binary records, oldest first
+    void writeBinary(Print & out) const;
+    // Write the events as Chrome trace event JSON
+    void writeChromeJSON(Print & out) const;
+
+private:
+    SIMCOM_TraceEvent * _buffer;
+    size_t _size;
+    size_t _head;               // where the next event goes
+    size_t _count;
+    uint32_t _dropped;
+};
+
+/*!
+ * \brief A trace ring with its own buffer
+ */
+template <size_t N>
+class SIMCOM_StaticTraceRing : public SIMCOM_TraceRing {
+public:
+    SIMCOM_StaticTraceRing() : SIMCOM_TraceRing(_events, N) {}
+private:
+    SIMCOM_TraceEvent _events[N];
+};
+
+/*!
+ * \brief Convert trace events to Chrome trace event JSON
+ *
+ * The output can be loaded in chrome://tracing or ui.perfetto.dev.
+ * Commands, sleeps and power on/off are shown as spans on separate
+ * tracks, the first byte and URCs as instant events.
+ *
+ * Feed it the events, oldest first. For example on the host, with
+ * a binary dump of the ring:
+ *   writer.begin();
+ *   for (each record of SIMCOM_TRACE_RECORD_SIZE bytes) {
+ *       SIMCOM_ChromeTraceWriter::decode(record, &event);
+ *       writer.add(event);
+ *   }
+ *   writer.end();
+ */
+class SIMCOM_ChromeTraceWriter {
+public:
+    SIMCOM_ChromeTraceWriter(Print & out);
+
+    void begin();
+    void add(const SIMCOM_TraceEvent & event);
+    void end();
+
+    // Decode a record of the binary dump
+    static void decode(const uint8_t * record, SIMCOM_TraceEvent * event);
+
+private:
+    void closeCommand();
+    void writeHead(const __FlashStringHelper * phase, uint8_t track, uint64_t ts);
+    void writeName(const char * name);
+    void writeSpan(uint8_t track, const char * name, uint64_t start, uint64_t end);
+    void writeInstant(uint8_t track, const char * name, uint64_t ts, const char * result = NULL);
+    void writeTime(uint64_t us);
+
+    Print & _out;
+    bool _first;
+    bool _started;
+    uint32_t _lastTs;
+    uint64_t _time;             // us, without the wrap around of micros()
+
+    // The open spans
+    bool _inCommand;
+    uint8_t _command;
+    uint64_t _commandStart;
+    uint64_t _commandLast;      // the last reply of the command
+    uint64_t _sleepStart;
+    uint64_t _powerStart;
+    bool _powerOn;
+};
+
+#endif
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+#include <string.h>
+#include <stdlib.h>
+#ifndef ARDUINO
+#include <stdio.h>
+#endif
+
+#include "SIMCOM_Transcript.h"
+#include "SIMCOM_Encoder.h"
+
+static const uint8_t transcriptMagic[4] = { 'S', 'I', 'M', 'T' };
+
+SIMCOM_RecordingStream::SIMCOM_RecordingStream(Stream & modem, Print & log) :
+    _modem(modem),
+    _log(log),
+    _headerDone(false),
+    _tx(false),
+    _runLength(0),
+    _runStart(0),
+    _lastByte(0),
+    _lastRun(micros())
+{
+}
+
+int SIMCOM_RecordingStream::read()
+{
+    int c = _modem.read();
+    if (c >= 0) {
+        add(false, c);
+    }
+    return c;
+}
+
+size_t SIMCOM_RecordingStream::write(uint8_t c)
+{
+    size_t retval = _modem.write(c);
+    add(true, c);
+    return retval;
+}
+
+void SIMCOM_RecordingStream::flush()
+{
+    writeRun();
+    _log.flush();
+    _modem.flush();
+}
+
+void SIMCOM_RecordingStream::add(bool tx, uint8_t c)
+{
+    uint32_t now = micros();
+    if (_runLength > 0 &&
+            (tx != _tx || _runLength >= sizeof(_run) || (now - _lastByte) > SIMCOM_TRANSCRIPT_GAP)) {
+        writeRun();
+    }
+    if (_runLength == 0) {
+        _tx = tx;
+        _runStart = now;
+    }
+    _run[_runLength++] = c;
+    _lastByte = now;
+}
+
+void SIMCOM_RecordingStream::writeRun()
+{
+    if (_runLength == 0) {
+        return;
+    }
+    if (!_headerDone) {
+        _log.write(transcriptMagic, sizeof(transcriptMagic));
+        _log.write((uint8_t)SIMCOM_TRANSCRIPT_VERSION);
+        _headerDone = true;
+    }
+    _log.write((uint8_t)((_tx ? SIMCOM_TRANSCRIPT_TX : 0) | (_runLength - 1)));
+    SIMCOM_Varint::write(&_log, _runStart - _lastRun);
+    _log.write(_run, _runLength);
+    _lastRun = _runStart;
+    _runLength = 0;
+}
+
+SIMCOM_ReplayStream::SIMCOM_ReplayStream(const uint8_t * data, size_t size, uint16_t speed) :
+    _data(data),
+    _size(size),
+#ifndef ARDUINO
+    _loaded(0),
+#endif
+    _speed(speed),
+    _clock(&SIMCOM_arduinoClock)
+{
+    begin();
+}
+
+#ifndef ARDUINO
+SIMCOM_ReplayStream::~SIMCOM_ReplayStream()
+{
+    free(_loaded);
+}
+
+bool SIMCOM_ReplayStream::load(const char * path)
+{
+    FILE * fp = fopen(path, "rb");
+    if (!fp) {
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t * data = size > 0 ? (uint8_t *)malloc(size) : 0;
+    bool retval = data && fread(data, 1, size, fp) == (size_t)size;
+    fclose(fp);
+    if (!retval) {
+        free(data);
+        return false;
+    }
+    free(_loaded);
+    _loaded = data;
+    _data = data;
+    _size = size;
+    begin();
+    return _valid;
+}
+#endif
+
+void SIMCOM_ReplayStream::begin()
+{
+    _valid = _data && _size >= SIMCOM_TRANSCRIPT_HEADER_SIZE &&
+            memcmp(_data, transcriptMagic, sizeof(transcriptMagic)) == 0 &&
+            _data[4] == SIMCOM_TRANSCRIPT_VERSION;
+    _mismatches = 0;
+    _firstMismatch = 0;
+    _anchorReal = _clock->micros();
+    _anchorTime = 0;
+
+    Cursor start = { 0, _valid ? SIMCOM_TRANSCRIPT_HEADER_SIZE : _size, 0, 0, 0 };
+    _txCursor = start;
+    _rxCursor = start;
+    nextRun(_txCursor, true);
+    nextRun(_rxCursor, false);
+}
+
+/*
+ * \brief Move the cursor to the next run in the given direction
+ *
+ * Returns false at the end of the transcript. The start is then
+ * the size, so that everything is before it.
+ */
+bool SIMCOM_ReplayStream::nextRun(Cursor & cursor, bool tx)
+{
+    size_t pos = cursor.pos;
+    while (pos < _size) {
+        size_t start = pos;
+        uint8_t tag = _data[pos++];
+        // The varint with the delta time
+        uint32_t delta = 0;
+        uint8_t shift = 0;
+        while (pos < _size) {
+            uint8_t b = _data[pos++];
+            delta |= (uint32_t)(b & 0x7F) << shift;
+            shift += 7;
+            if ((b & 0x80) == 0 || shift >= 32) {
+                break;
+            }
+        }
+        cursor.time += delta;
+        size_t len = (tag & ~SIMCOM_TRANSCRIPT_TX) + 1;
+        if (len > _size - pos) {
+            // Truncated
+            len = _size - pos;
+        }
+        if (((tag & SIMCOM_TRANSCRIPT_TX) != 0) == tx && len > 0) {
+            cursor.start = start;
+            cursor.data = pos;
+            cursor.remaining = len;
+            cursor.pos = pos + len;
+            return true;
+        }
+        pos += len;
+    }
+    cursor.start = _size;
+    cursor.pos = _size;
+    cursor.remaining = 0;
+    return false;
+}
+
+/*
+ * \brief Is the current reply run available?
+ */
+bool SIMCOM_ReplayStream::released()
+{
+    if (_rxCursor.remaining == 0) {
+        return false;
+    }
+    // Not before the commands that came before it were written
+    if (_txCursor.start < _rxCursor.start) {
+        return false;
+    }
+    if (_speed == 0 || _rxCursor.time <= _anchorTime) {
+        return true;
+    }
+    return (uint64_t)(_clock->micros() - _anchorReal) * _speed >= _rxCursor.time - _anchorTime;
+}
+
+int SIMCOM_ReplayStream::available()
+{
+    return released() ? _rxCursor.remaining : 0;
+}
+
+int SIMCOM_ReplayStream::peek()
+{
+    return released() ? _data[_rxCursor.data] : -1;
+}
+
+int SIMCOM_ReplayStream::read()
+{
+    if (!released()) {
+        return -1;
+    }
+    int c = _data[_rxCursor.data++];
+    if (--_rxCursor.remaining == 0) {
+        nextRun(_rxCursor, false);
+    }
+    return c;
+}
+
+size_t SIMCOM_ReplayStream::write(uint8_t c)
+{
+    if (_txCursor.remaining == 0) {
+        // More than was recorded
+        if (_mismatches++ == 0) {
+            _firstMismatch = _size;
+        }
+        return 1;
+    }
+    if (_data[_txCursor.data] != c) {
+        if (_mismatches++ == 0) {
+            _firstMismatch = _txCursor.data;
+        }
+    }
+    ++_txCursor.data;
+    if (--_txCursor.remaining == 0) {
+        // The replies are timed from here
+        _anchorReal = _clock->micros();
+        _anchorTime = _txCursor.time;
+        nextRun(_txCursor, true);
+    }
+    return 1;
+}
+
+bool SIMCOM_ReplayStream::isDone()
+{
+    return _rxCursor.remaining == 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2015-2016 Kees Bakker.  All rights reserved.
+ *
+ * This file is part of GPRSbee.
+ *
+ * GPRSbee is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or(at your option) any later version.
+ *
+ * GPRSbee is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GPRSbee.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCOM_TRANSCRIPT_h
+#define _SIMCOM_TRANSCRIPT_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Stream.h>
+#include "SIMCOM_Clock.h"
+
+/*
+ * The transcript is a header followed by runs of bytes:
+ *   "SIMT" <version>
+ *   <tag> <delta> <bytes>...
+ * <tag> bit 7 is set for bytes sent to the modem, bits 6..0 are the
+ * number of bytes minus one. <delta> is a varint with the time in
+ * microseconds since the previous run.
+ */
+#define SIMCOM_TRANSCRIPT_VERSION       1
+#define SIMCOM_TRANSCRIPT_HEADER_SIZE   5
+#define SIMCOM_TRANSCRIPT_TX            0x80
+
+// A run is written when it is full, when the direction changes, or
+// when there is a gap of more than this (us) between bytes
+#define SIMCOM_TRANSCRIPT_RUN_SIZE      32
+#define SIMCOM_TRANSCRIPT_GAP           2000
+
+/*!
+ * \brief A Stream that records all bytes to and from the modem
+ *
+ * Put it between the modem stream and the modem:
+ *   SIMCOM_RecordingStream rec(Serial1, logFile);
+ *   gprsbee.init(rec, onoff);
+ * The recording goes to a Print, e.g. a file on an SD card. Call
+ * flush() before closing it.
+ */
+class SIMCOM_RecordingStream : public Stream {
+public:
+    SIMCOM_RecordingStream(Stream & modem, Print & log);
+
+    int available() { return _modem.available(); }
+    int peek() { return _modem.peek(); }
+    int read();
+    size_t write(uint8_t c);
+    void flush();
+
+private:
+    void add(bool tx, uint8_t c);
+    void writeRun();
+
+    Stream & _modem;
+    Print & _log;
+    bool _headerDone;
+    bool _tx;
+    uint8_t _runLength;
+    uint32_t _runStart;         // micros() of the first byte of the run
+    uint32_t _lastByte;         // micros() of the last byte
+    uint32_t _lastRun;          // micros() of the previous run
+    uint8_t _run[SIMCOM_TRANSCRIPT_RUN_SIZE];
+};
+
+/*!
+ * \brief A Stream that plays back a recorded transcript
+ *
+ * The bytes that the modem sent are given back, each run not before
+ * the bytes that were sent to the modem before it were written. The
+ * timing of a run is relative to the last command that was written,
+ * divided by the speed (1 is the original timing). With speed 0 the
+ * replies are there as soon as the command was written.
+ *
+ * What is written is compared with the recording, mismatches()
+ * tells if the code under test behaved differently.
+ */
+class SIMCOM_ReplayStream : public Stream {
+public:
+    SIMCOM_ReplayStream(const uint8_t * data, size_t size, uint16_t speed = 1);
+#ifndef ARDUINO
+    ~SIMCOM_ReplayStream();
+    // Read the transcript from a file. Returns false if that fails.
+    bool load(const char * path);
+#endif
+
+    // Returns false if the data is not a transcript
+    bool isValid() const { return _valid; }
+    void setSpeed(uint16_t speed) { _speed = speed; }
+    // Use another clock for the timing, e.g. the virtual clock of the modem
+    void setClock(SIMCOM_Clock & clock) { _clock = &clock; _anchorReal = clock.micros(); }
+
+    int available();
+    int peek();
+    int read();
+    size_t write(uint8_t c);
+
+    // True if all the recorded replies were read
+    bool isDone();
+    // The number of written bytes that differ from the recording
+    uint32_t mismatches() const { return _mismatches; }
+    // The offset in the transcript of the first mismatch
+    size_t firstMismatch() const { return _firstMismatch; }
+
+private:
+    struct Cursor {
+        size_t start;           // of the tag of the current run
+        size_t pos;             // of the next tag
+        size_t data;            // of the next byte of the current run
+        uint8_t remaining;      // bytes of the current run
+        uint32_t time;          // of the current run, us since the start
+    };
+    void begin();
+    bool nextRun(Cursor & cursor, bool tx);
+    bool released();
+
+    const uint8_t * _data;
+    size_t _size;
+#ifndef ARDUINO
+    uint8_t * _loaded;
+#endif
+    bool _valid;
+    uint16_t _speed;
+    SIMCOM_Clock * _clock;
+    Cursor _txCursor;
+    Cursor _rxCursor;
+    uint32_t _anchorReal;       // the clock when the last command was written (us)
+    uint32_t _anchorTime;       // its recorded time
+    uint32_t _mismatches;
+    size_t _firstMismatch;
+};
+
+#endif
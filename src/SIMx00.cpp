@@ -20,10 +20,11 @@
 
 #include "SIMx00.h" 
 #include "SIMCOM_Modem.h"
+#include "SIMCOM_Reply.h"
 
 #if ENABLE_GPRSBEE_DIAG
-#define diagPrint(...) { if (_diagStream) _diagStream->print(__VA_ARGS__); }
-#define diagPrintLn(...) { if (_diagStream) _diagStream->println(__VA_ARGS__); }
+#define diagPrint(...) SIMCOM_LOG(_log, SIMCOM_LOG_ERROR, __VA_ARGS__)
+#define diagPrintLn(...) SIMCOM_LOGLN(_log, SIMCOM_LOG_ERROR, __VA_ARGS__)
 #else
 #define diagPrint(...)
 #define diagPrintLn(...)
@@ -37,20 +38,32 @@ void SIMx00::init(Stream & stream, SIMCOM_Modem_OnOff &onoff, int bufferSize)
 
 void SIMx00::initProlog(Stream &stream, size_t bufferSize)
 {
-  _inputBufferSize = bufferSize;
+  if (!_isBufferInitialized) {
+    _inputBufferSize = bufferSize;
+  }
   initBuffer();
 
   _modemStream = &stream;
   _diagStream = 0;
+  _log.setSink(0);
 
   _ftpMaxLength = 0;
   _transMode = false;
+  _bearerKey = 0;
 
   _echoOff = false;
-  _skipCGATT = false;
   _changedSkipCGATT = false;
 
+#if SIMCOM_MODEM_PRODUCT == SIMCOM_PRODUCT_SIM900
+  _productId = prodid_SIM900;
+  _skipCGATT = false;
+#elif SIMCOM_MODEM_PRODUCT == SIMCOM_PRODUCT_SIM800
+  _productId = prodid_SIM800;
+  _skipCGATT = true;
+#else
   _productId = prodid_unknown;
+  _skipCGATT = false;
+#endif
 
   _timeToOpenTCP = 0;
   _timeToCloseTCP = 0;
@@ -58,6 +71,7 @@ void SIMx00::initProlog(Stream &stream, size_t bufferSize)
 
 bool SIMx00::isAlive()
 {
+  SIMCOM_Transaction transaction(*this);
   // Send "AT" and wait for "OK"
   // Try it at least 3 times before deciding it failed
   for (int i = 0; i < 3; i++) {
@@ -78,6 +92,12 @@ void SIMx00::switchEchoOff()
         // Should we retry?
         return;
     }
+    // Report errors as +CME ERROR: <err>, instead of just ERROR
+    sendCommandProlog();
+    sendCommandAdd_P(PSTR("AT+CMEE="));
+    sendCommandAdd((int)_cmeeMode);
+    sendCommandEpilog();
+    waitForOK();
     // Also disable URCs
     disableCIURC();
     _echoOff = true;
@@ -89,6 +109,7 @@ void SIMx00::switchEchoOff()
  */
 bool SIMx00::networkOn()
 {
+  SIMCOM_Transaction transaction(*this);
   bool status;
   status = on();
   if (status) {
@@ -107,11 +128,15 @@ bool SIMx00::networkOn()
 // Returns true if successful.
 bool SIMx00::getRSSIAndBER(int8_t* rssi, uint8_t* ber)
 {
-    static char berValues[] = { 49, 43, 37, 25, 19, 13, 7, 0 }; // 3GPP TS 45.008 [20] subclause 8.2.4
+    SIMCOM_Transaction transaction(*this);
+    static const char berValues[] = { 49, 43, 37, 25, 19, 13, 7, 0 }; // 3GPP TS 45.008 [20] subclause 8.2.4
     int rssiRaw = 0;
-    int berRaw = 0;
-    // TODO get BER value
-    if (getIntValue("AT+CSQ", "+CSQ:", &rssiRaw, millis() + 12000 )) {
+    int berRaw = 99;
+    // +CSQ: <rssi>,<ber>
+    sendCommand_P(PSTR("AT+CSQ"));
+    if (waitForMessage_P(PSTR("+CSQ:"), _clock->millis() + 12000) &&
+            SIMCOM_scanReply(_inputBuffer, PSTR("+CSQ: %d,%d"), &rssiRaw, &berRaw) == 2 &&
+            waitForOK()) {
         *rssi = ((rssiRaw == 99) ? 0 : -113 + 2 * rssiRaw);
         *ber = ((berRaw == 99 || static_cast<size_t>(berRaw) >= sizeof(berValues)) ? 0 : berValues[berRaw]);
 
@@ -123,25 +148,28 @@ bool SIMx00::getRSSIAndBER(int8_t* rssi, uint8_t* ber)
 
 bool SIMx00::waitForSignalQuality()
 {
+    SIMCOM_Transaction transaction(*this);
     /*
-     * The timeout is just a wild guess. If the mobile connection
-     * is really bad, or even absent, then it is a waste of time
-     * (and battery) to even try.
+     * The deadline of the policy is just a wild guess. If the mobile
+     * connection is really bad, or even absent, then it is a waste of
+     * time (and battery) to even try.
      */
-    uint32_t start = millis();
-    uint32_t ts_max = start + 30000;
+    uint32_t start = _clock->millis();
     int8_t rssi;
     uint8_t ber;
+    bool ok = false;
+    SIMCOM_Retry retry(SIMCOM_RETRY_SIGNAL, getRetryPolicy(SIMCOM_RETRY_SIGNAL), start);
 
-    while (!isTimedOut(ts_max)) {
+    while (!ok && nextAttempt(retry)) {
         if (getRSSIAndBER(&rssi, &ber)) {
-            if (rssi != 0 && rssi >= _minSignalQuality) {
-                _lastRSSI = rssi;
-                _CSQtime = (int32_t) (millis() - start) / 1000;
-                return true;
-            }
+            ok = rssi != 0 && rssi >= _minSignalQuality;
         }
-        /*sodaq_wdt_safe_*/ delay(500);
+    }
+    retryDone(retry, ok);
+    if (ok) {
+        _lastRSSI = rssi;
+        _CSQtime = (int32_t) (_clock->millis() - start) / 1000;
+        return true;
     }
     _lastRSSI = 0;
     return false;
@@ -149,8 +177,9 @@ bool SIMx00::waitForSignalQuality()
 
 bool SIMx00::waitForCREG()
 {
+  SIMCOM_Transaction transaction(*this);
   // TODO This timeout is maybe too long.
-  uint32_t ts_max = millis() + 120000;
+  uint32_t ts_max = _clock->millis() + 120000;
   int value;
   while (!isTimedOut(ts_max)) {
     sendCommand_P(PSTR("AT+CREG?"));
@@ -164,12 +193,8 @@ bool SIMx00::waitForCREG()
     // 4 = Unknown
     // 5 = Registered, roaming
     value = 0;
-    if (waitForMessage_P(PSTR("+CREG:"), millis() + 12000)) {
-      const char *ptr = strchr(_inputBuffer, ',');
-      if (ptr) {
-        ++ptr;
-        value = strtoul(ptr, NULL, 0);
-      }
+    if (waitForMessage_P(PSTR("+CREG:"), _clock->millis() + 12000)) {
+      SIMCOM_scanReply(_inputBuffer, PSTR("+CREG: %*,%d"), &value);
     }
     waitForOK();
     if (value == 1 || value == 5) {
@@ -206,6 +231,7 @@ bool SIMx00::connectProlog()
     return false;
   }
 
+#if SIMCOM_MODEM_PRODUCT == SIMCOM_PRODUCT_AUTO
   if (!_changedSkipCGATT && _productId == prodid_unknown) {
     // Try to figure out what kind it is. SIM900? SIM800? etc.
     setProductId();
@@ -213,6 +239,7 @@ bool SIMx00::connectProlog()
       _skipCGATT = true;
     }
   }
+#endif
 
   // Attach to GPRS service
   // We need a longer timeout than the normal waitForOK
@@ -246,9 +273,9 @@ bool SIMx00::openTCP(const char *apn,
 bool SIMx00::openTCP(const char *apn, const char *apnuser, const char *apnpwd,
     const char *server, int port, bool transMode)
 {
+  SIMCOM_Transaction transaction(*this);
   uint32_t ts_max;
   boolean retval = false;
-  char cmdbuf[60];              // big enough for AT+CIPSTART="TCP","server",8500
   PGM_P CIPSTART_replies[] = {
       PSTR("CONNECT OK"),
       PSTR("CONNECT"),
@@ -267,18 +294,18 @@ bool SIMx00::openTCP(const char *apn, const char *apnuser, const char *apnpwd,
   }
 
   // AT+CSTT=<apn>,<username>,<password>
-  strcpy_P(cmdbuf, PSTR("AT+CSTT=\""));
-  strcat(cmdbuf, apn);
-  strcat(cmdbuf, "\",\"");
-  if (apnuser) {
-    strcat(cmdbuf, apnuser);
-  }
-  strcat(cmdbuf, "\",\"");
-  if (apnpwd) {
-    strcat(cmdbuf, apnpwd);
-  }
-  strcat(cmdbuf, "\"");
-  if (!sendCommandWaitForOK(cmdbuf)) {
+  if (!checkQuotable(apn) || !checkQuotable(apnuser) || !checkQuotable(apnpwd)) {
+    goto cmd_error;
+  }
+  sendCommandProlog();
+  sendCommandAdd_P(PSTR("AT+CSTT="));
+  sendCommandAddQuoted(apn);
+  sendCommandAdd(',');
+  sendCommandAddQuoted(apnuser);
+  sendCommandAdd(',');
+  sendCommandAddQuoted(apnpwd);
+  sendCommandEpilog();
+  if (!waitForOK()) {
     goto cmd_error;
   }
 
@@ -295,7 +322,7 @@ bool SIMx00::openTCP(const char *apn, const char *apnuser, const char *apnpwd,
 
   // AT+CIPSHUT
   sendCommand_P(PSTR("AT+CIPSHUT"));
-  ts_max = millis() + 4000;             // Is this enough?
+  ts_max = _clock->millis() + 4000;             // Is this enough?
   if (!waitForMessage_P(PSTR("SHUT OK"), ts_max)) {
     goto cmd_error;
   }
@@ -313,14 +340,19 @@ bool SIMx00::openTCP(const char *apn, const char *apnuser, const char *apnpwd,
 
   // Start up the connection
   // AT+CIPSTART="TCP","server",8500
-  strcpy_P(cmdbuf, PSTR("AT+CIPSTART=\"TCP\",\""));
-  strcat(cmdbuf, server);
-  strcat_P(cmdbuf, PSTR("\","));
-  itoa(port, cmdbuf + strlen(cmdbuf), 10);
-  if (!sendCommandWaitForOK(cmdbuf)) {
+  if (!checkQuotable(server)) {
     goto cmd_error;
   }
-  ts_max = millis() + 15000;            // Is this enough?
+  sendCommandProlog();
+  sendCommandAdd_P(PSTR("AT+CIPSTART=\"TCP\","));
+  sendCommandAddQuoted(server);
+  sendCommandAdd(',');
+  sendCommandAdd(port);
+  sendCommandEpilog();
+  if (!waitForOK()) {
+    goto cmd_error;
+  }
+  ts_max = _clock->millis() + 15000;            // Is this enough?
   int ix;
   if ((ix = waitForMessages(CIPSTART_replies, nrReplies, ts_max)) < 0) {
     // For some weird reason the SIM900 in some cases does not want
@@ -341,7 +373,7 @@ bool SIMx00::openTCP(const char *apn, const char *apnuser, const char *apnpwd,
 
   _transMode = transMode;
   retval = true;
-  _timeToOpenTCP = millis() - _startOn;
+  _timeToOpenTCP = _clock->millis() - _startOn;
   goto ending;
 
 cmd_error:
@@ -354,29 +386,33 @@ ending:
 
 void SIMx00::closeTCP(bool switchOff)
 {
+  SIMCOM_Transaction transaction(*this);
   uint32_t ts_max;
   // AT+CIPSHUT
   // Maybe we should do AT+CIPCLOSE=1
   if (_transMode) {
     mydelay(1000);
     _modemStream->print(F("+++"));
+    countTx(3);
     mydelay(500);
     // TODO Will the SIM900 answer with "OK"?
   }
   sendCommand_P(PSTR("AT+CIPSHUT"));
-  ts_max = millis() + 4000;             // Is this enough?
+  ts_max = _clock->millis() + 4000;             // Is this enough?
   if (!waitForMessage_P(PSTR("SHUT OK"), ts_max)) {
     diagPrintLn(F("closeTCP failed!"));
   }
+  _transMode = false;
 
   if (switchOff) {
-    off();
+    offOrSleep(true);
   }
-  _timeToCloseTCP = millis() - _startOn;
+  _timeToCloseTCP = _clock->millis() - _startOn;
 }
 
 bool SIMx00::isTCPConnected()
 {
+  SIMCOM_Transaction transaction(*this);
   uint32_t ts_max;
   bool retval = false;
   const char *ptr;
@@ -389,6 +425,7 @@ bool SIMx00::isTCPConnected()
     // We need to send +++
     mydelay(1000);
     _modemStream->print(F("+++"));
+    countTx(3);
     mydelay(500);
     if (!waitForOK()) {
       goto end;
@@ -400,10 +437,12 @@ bool SIMx00::isTCPConnected()
   // OK
   // STATE: <state>
   // The only good answer is "CONNECT OK"
-  if (!sendCommandWaitForOK_P(PSTR("AT+CIPSTATUS"))) {
+  // Not sendCommandWaitForOK_P(), a safe point after the OK would eat STATE:
+  sendCommand_P(PSTR("AT+CIPSTATUS"));
+  if (!waitForOK()) {
     goto end;
   }
-  ts_max = millis() + 4000;             // Is this enough?
+  ts_max = _clock->millis() + 4000;             // Is this enough?
   if (!waitForMessage_P(PSTR("STATE:"), ts_max)) {
     goto end;
   }
@@ -418,7 +457,7 @@ bool SIMx00::isTCPConnected()
     // We must switch back to transparent mode
     sendCommand_P(PSTR("ATO0"));
     // TODO wait for "CONNECT" or "NO CARRIER"
-    ts_max = millis() + 4000;             // Is this enough? Or too much
+    ts_max = _clock->millis() + 4000;             // Is this enough? Or too much
     if (!waitForMessage_P(PSTR("CONNECT"), ts_max)) {
       goto end;
     }
@@ -435,24 +474,56 @@ end:
  */
 bool SIMx00::sendDataTCP(const uint8_t *data, size_t data_len)
 {
+  SIMCOM_BufferBody body(data, data_len);
+  return sendDataTCP(body);
+}
+
+/*!
+ * \brief Send a list of fragments over the TCP connection
+ *
+ * The fragments are sent back to back, CIPSEND gets the sum of the lengths.
+ */
+bool SIMx00::sendDataTCP(const SIMCOM_IOVec * iov, size_t nr)
+{
+  SIMCOM_IOVecBody body(iov, nr);
+  return sendDataTCP(body);
+}
+
+/*!
+ * \brief Send some data over the TCP connection, rendered by the producer
+ *
+ * The body is rendered twice: first to compute the length for CIPSEND,
+ * then to send the bytes directly into the modem stream.
+ */
+bool SIMx00::sendDataTCP(SIMCOM_BodyProducer & body)
+{
+  SIMCOM_Transaction transaction(*this);
   uint32_t ts_max;
   bool retval = false;
+  size_t data_len = body.length();
+  PGM_P CIPSEND_replies[] = {
+      PSTR("SEND OK"),
+      PSTR("SEND FAIL"),
+  };
 
   sendCommandProlog();
   sendCommandAdd_P(PSTR("AT+CIPSEND="));
-  sendCommandAdd((int)data_len);
+  sendCommandAdd((unsigned long)data_len);
   sendCommandEpilog();
-  ts_max = millis() + 4000;             // Is this enough?
+  ts_max = _clock->millis() + 4000;             // Is this enough?
   if (!waitForPrompt("> ", ts_max)) {
     goto error;
   }
   mydelay(50);          // TODO Why do we need this?
   // Send the data
-  for (size_t i = 0; i < data_len; ++i) {
-    _modemStream->print((char)*data++);
+  if (!sendBody(body, data_len)) {
+    // The modem got the announced length anyway. Wait for its reply
+    // so that it is out of data mode.
+    waitForMessages(CIPSEND_replies, sizeof(CIPSEND_replies) / sizeof(CIPSEND_replies[0]), _clock->millis() + 4000);
+    goto error;
   }
   //
-  ts_max = millis() + 4000;             // Is this enough?
+  ts_max = _clock->millis() + 4000;             // Is this enough?
   if (!waitForMessage_P(PSTR("SEND OK"), ts_max)) {
     goto error;
   }
@@ -473,17 +544,21 @@ ending:
  */
 bool SIMx00::receiveDataTCP(uint8_t *data, size_t data_len, uint16_t timeout)
 {
+  SIMCOM_Transaction transaction(*this);
   uint32_t ts_max;
   bool retval = false;
 
   //diagPrintLn(F("receiveDataTCP"));
-  ts_max = millis() + timeout;
+  ts_max = _clock->millis() + timeout;
   while (data_len > 0 && !isTimedOut(ts_max)) {
     if (_modemStream->available() > 0) {
       uint8_t b;
       b = _modemStream->read();
+      countRx(1);
       *data++ = b;
       --data_len;
+    } else {
+      idle(ts_max);
     }
   }
   if (data_len == 0) {
@@ -498,12 +573,13 @@ bool SIMx00::receiveDataTCP(uint8_t *data, size_t data_len, uint16_t timeout)
  */
 bool SIMx00::receiveLineTCP(const char **buffer, uint16_t timeout)
 {
+  SIMCOM_Transaction transaction(*this);
   uint32_t ts_max;
   bool retval = false;
 
   //diagPrintLn(F("receiveLineTCP"));
   *buffer = NULL;
-  ts_max = millis() + timeout;
+  ts_max = _clock->millis() + timeout;
   if (readLine(ts_max) < 0) {
     goto ending;
   }
@@ -526,8 +602,7 @@ bool SIMx00::openFTP(const char *apn,
 bool SIMx00::openFTP(const char *apn, const char *apnuser, const char *apnpwd,
     const char *server, const char *username, const char *password)
 {
-  char cmd[64];
-
+  SIMCOM_Transaction transaction(*this);
   if (!on()) {
     goto ending;
   }
@@ -545,27 +620,15 @@ bool SIMx00::openFTP(const char *apn, const char *apnuser, const char *apnpwd,
   }
 
   // connect to FTP server
-  //snprintf(cmd, sizeof(cmd), "AT+FTPSERV=\"%s\"", server);
-  strcpy_P(cmd, PSTR("AT+FTPSERV=\""));
-  strcat(cmd, server);
-  strcat(cmd, "\"");
-  if (!sendCommandWaitForOK(cmd)) {
+  if (!sendQuotedCommandWaitForOK_P(PSTR("AT+FTPSERV="), server)) {
     goto cmd_error;
   }
 
   // optional "AT+FTPPORT=21";
-  //snprintf(cmd, sizeof(cmd), "AT+FTPUN=\"%s\"", username);
-  strcpy_P(cmd, PSTR("AT+FTPUN=\""));
-  strcat(cmd, username);
-  strcat(cmd, "\"");
-  if (!sendCommandWaitForOK(cmd)) {
+  if (!sendQuotedCommandWaitForOK_P(PSTR("AT+FTPUN="), username)) {
     goto cmd_error;
   }
-  //snprintf(cmd, sizeof(cmd), "AT+FTPPW=\"%s\"", password);
-  strcpy_P(cmd, PSTR("AT+FTPPW=\""));
-  strcat(cmd, password);
-  strcat(cmd, "\"");
-  if (!sendCommandWaitForOK(cmd)) {
+  if (!sendQuotedCommandWaitForOK_P(PSTR("AT+FTPPW="), password)) {
     goto cmd_error;
   }
 
@@ -581,7 +644,8 @@ ending:
 
 bool SIMx00::closeFTP()
 {
-  off();            // Ignore errors
+  SIMCOM_Transaction transaction(*this);
+  offOrSleep(true); // Ignore errors
   return true;
 }
 
@@ -590,61 +654,55 @@ bool SIMx00::closeFTP()
  */
 bool SIMx00::openFTPfile(const char *fname, const char *path)
 {
-  char cmd[64];
-  const char * ptr;
-  int retry;
+  SIMCOM_Transaction transaction(*this);
   uint32_t ts_max;
+  bool ok = false;
 
   // Open FTP file
-  //snprintf(cmd, sizeof(cmd), "AT+FTPPUTNAME=\"%s\"", fname);
-  strcpy_P(cmd, PSTR("AT+FTPPUTNAME=\""));
-  strcat(cmd, fname);
-  strcat(cmd, "\"");
-  if (!sendCommandWaitForOK(cmd)) {
+  if (!sendQuotedCommandWaitForOK_P(PSTR("AT+FTPPUTNAME="), fname)) {
     goto ending;
   }
-  //snprintf(cmd, sizeof(cmd), "AT+FTPPUTPATH=\"%s\"", FTPPATH);
-  strcpy_P(cmd, PSTR("AT+FTPPUTPATH=\""));
-  strcat(cmd, path);
-  strcat(cmd, "\"");
-  if (!sendCommandWaitForOK(cmd)) {
+  if (!sendQuotedCommandWaitForOK_P(PSTR("AT+FTPPUTPATH="), path)) {
     goto ending;
   }
 
   // Repeat until we get OK
-  for (retry = 0; retry < 5; retry++) {
-    if (sendCommandWaitForOK_P(PSTR("AT+FTPPUT=1"))) {
+  {
+    SIMCOM_Retry retry(SIMCOM_RETRY_FTPPUT, getRetryPolicy(SIMCOM_RETRY_FTPPUT), _clock->millis());
+    while (!ok && nextAttempt(retry)) {
+      // No safe point between the OK and +FTPPUT:
+      sendCommand_P(PSTR("AT+FTPPUT=1"));
+      if (!waitForOK()) {
+        continue;
+      }
       // +FTPPUT:1,1,1360  <= the 1360 is <maxlength>
       // +FTPPUT:1,61      <= this is an error (Net error)
       // +FTPPUT:1,66      <= this is an error (operation not allowed)
       // This can take a while ...
-      ts_max = millis() + 30000;
+      ts_max = _clock->millis() + 30000;
       if (!waitForMessage_P(PSTR("+FTPPUT:"), ts_max)) {
         // Try again.
         isAlive();
+        setError(SIMCOM_ERRKIND_TIMEOUT);
         continue;
       }
-      // Skip 8 for "+FTPPUT:"
-      ptr = _inputBuffer + 8;
-      ptr = skipWhiteSpace(ptr);
-      if (strncmp_P(ptr, PSTR("1,"), 2) != 0) {
-        // We did NOT get "+FTPPUT:1,1,", it might be an error.
-        goto ending;
-      }
-      ptr += 2;
-
-      if (strncmp_P(ptr, PSTR("1,"), 2) != 0) {
-        // We did NOT get "+FTPPUT:1,1,", it might be an error.
-        goto ending;
+      {
+        int mode = 0;
+        int status = 0;
+        long maxLength = 0;
+        if (SIMCOM_scanReply(_inputBuffer, PSTR("+FTPPUT: %d,%d,%l"), &mode, &status, &maxLength) != 3 ||
+            mode != 1 || status != 1) {
+          // We did NOT get "+FTPPUT:1,1,<maxlength>", it might be an error.
+          break;
+        }
+        _ftpMaxLength = maxLength;
       }
-      ptr += 2;
-
-      _ftpMaxLength = strtoul(ptr, NULL, 0);
 
-      break;
+      ok = true;
     }
+    retryDone(retry, ok);
   }
-  if (retry >= 5) {
+  if (!ok) {
     goto ending;
   }
 
@@ -656,8 +714,10 @@ ending:
 
 bool SIMx00::closeFTPfile()
 {
-  // Close file
-  if (!sendCommandWaitForOK_P(PSTR("AT+FTPPUT=2,0"))) {
+  SIMCOM_Transaction transaction(*this);
+  // Close file, no safe point between the OK and +FTPPUT:
+  sendCommand_P(PSTR("AT+FTPPUT=2,0"));
+  if (!waitForOK()) {
     return false;
   }
 
@@ -672,7 +732,7 @@ bool SIMx00::closeFTPfile()
    * The FTP file seems to be closed properly, so why bother?
    */
   // +FTPPUT:1,0
-  uint32_t ts_max = millis() + 20000;
+  uint32_t ts_max = _clock->millis() + 20000;
   if (!waitForMessage_P(PSTR("+FTPPUT:"), ts_max)) {
     // How bad is it if we ignore this
     //diagPrintLn(F("Timeout while waiting for +FTPPUT:1,"));
@@ -689,17 +749,16 @@ bool SIMx00::closeFTPfile()
  */
 bool SIMx00::sendFTPdata_low(uint8_t *buffer, size_t size)
 {
-  char cmd[20];         // Should be enough for "AT+FTPPUT=2,<num>"
   uint32_t ts_max;
   uint8_t *ptr = buffer;
 
   // Send some data
-  //snprintf(cmd, sizeof(cmd), "AT+FTPPUT=2,%d", size);
-  strcpy_P(cmd, PSTR("AT+FTPPUT=2,"));
-  itoa(size, cmd + strlen(cmd), 10);
-  sendCommand(cmd);
+  sendCommandProlog();
+  sendCommandAdd_P(PSTR("AT+FTPPUT=2,"));
+  sendCommandAdd((int)size);
+  sendCommandEpilog();
 
-  ts_max = millis() + 10000;
+  ts_max = _clock->millis() + 10000;
   // +FTPPUT:2,22
   if (!waitForMessage_P(PSTR("+FTPPUT:"), ts_max)) {
     // How bad is it if we ignore this
@@ -711,6 +770,7 @@ bool SIMx00::sendFTPdata_low(uint8_t *buffer, size_t size)
   for (size_t i = 0; i < size; ++i) {
     _modemStream->print((char)*ptr++);
   }
+  countTx(size);
   //_modemStream->print('\r');          // dummy <CR>, not sure if this is needed
 
   // Expected reply:
@@ -723,7 +783,7 @@ bool SIMx00::sendFTPdata_low(uint8_t *buffer, size_t size)
   }
 
   // The SIM900 informs again what the new max length is
-  ts_max = millis() + 4000;
+  ts_max = _clock->millis() + 4000;
   // +FTPPUT:1,1,1360
   if (!waitForMessage_P(PSTR("+FTPPUT:"), ts_max)) {
     // How bad is it if we ignore this?
@@ -735,17 +795,16 @@ bool SIMx00::sendFTPdata_low(uint8_t *buffer, size_t size)
 
 bool SIMx00::sendFTPdata_low(uint8_t (*read)(), size_t size)
 {
-  char cmd[20];         // Should be enough for "AT+FTPPUT=2,<num>"
   const char * ptr;
   uint32_t ts_max;
 
   // Send some data
-  //snprintf(cmd, sizeof(cmd), "AT+FTPPUT=2,%d", size);
-  strcpy_P(cmd, PSTR("AT+FTPPUT=2,"));
-  itoa(size, cmd + strlen(cmd), 10);
-  sendCommand(cmd);
+  sendCommandProlog();
+  sendCommandAdd_P(PSTR("AT+FTPPUT=2,"));
+  sendCommandAdd((int)size);
+  sendCommandEpilog();
 
-  ts_max = millis() + 10000;
+  ts_max = _clock->millis() + 10000;
   // +FTPPUT:2,22
   if (!waitForMessage_P(PSTR("+FTPPUT:"), ts_max)) {
     ptr = _inputBuffer + 8;
@@ -764,6 +823,7 @@ bool SIMx00::sendFTPdata_low(uint8_t (*read)(), size_t size)
   for (size_t i = 0; i < size; ++i) {
     _modemStream->print((char)(*read)());
   }
+  countTx(size);
 
   // Expected reply:
   // +FTPPUT:2,22
@@ -775,7 +835,7 @@ bool SIMx00::sendFTPdata_low(uint8_t (*read)(), size_t size)
   }
 
   // The SIM900 informs again what the new max length is
-  ts_max = millis() + 30000;
+  ts_max = _clock->millis() + 30000;
   // +FTPPUT:1,1,1360
   if (!waitForMessage_P(PSTR("+FTPPUT:"), ts_max)) {
     // How bad is it if we ignore this?
@@ -787,6 +847,7 @@ bool SIMx00::sendFTPdata_low(uint8_t (*read)(), size_t size)
 
 bool SIMx00::sendFTPdata(uint8_t *data, size_t size)
 {
+  SIMCOM_Transaction transaction(*this);
   // Send the bytes in chunks that are maximized by the maximum
   // FTP length
   while (size > 0) {
@@ -805,6 +866,7 @@ bool SIMx00::sendFTPdata(uint8_t *data, size_t size)
 
 bool SIMx00::sendFTPdata(uint8_t (*read)(), size_t size)
 {
+  SIMCOM_Transaction transaction(*this);
   // Send the bytes in chunks that are maximized by the maximum
   // FTP length
   while (size > 0) {
@@ -822,13 +884,44 @@ bool SIMx00::sendFTPdata(uint8_t (*read)(), size_t size)
 
 bool SIMx00::sendSMS(const char *telno, const char *text)
 {
-  char cmd[64];
-  uint32_t ts_max;
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;
 
-  if (!on()) {
-    goto ending;
+  if (on()) {
+    retval = sendSMSmiddle(telno, text);
+  }
+  offOrSleep(retval);
+  return retval;
+}
+
+bool SIMx00::sendSMSKeepPower(const char *telno, const char *text)
+{
+  SIMCOM_Transaction transaction(*this);
+  bool wasSleeping = isSleeping();
+  bool wasOn = SIMCOM_Modem::isOn() && !wasSleeping;
+  bool retval = false;
+
+  if (wasOn || on()) {
+    retval = sendSMSmiddle(telno, text);
+  }
+  if (wasSleeping) {
+    if (!sleep()) {
+      off();
+    }
+  } else if (!wasOn) {
+    offOrSleep(retval);
   }
+  return retval;
+}
+
+/*!
+ * \brief Send an SMS with the modem on
+ */
+bool SIMx00::sendSMSmiddle(const char *telno, const char *text)
+{
+  SIMCOM_Transaction transaction(*this);
+  uint32_t ts_max;
+  bool retval = false;
 
   // Suppress echoing
   switchEchoOff();
@@ -847,16 +940,16 @@ bool SIMx00::sendSMS(const char *telno, const char *text)
     goto cmd_error;
   }
 
-  strcpy_P(cmd, PSTR("AT+CMGS=\""));
-  strcat(cmd, telno);
-  strcat(cmd, "\"");
-  sendCommand(cmd);
-  ts_max = millis() + 4000;
+  if (!sendQuotedCommand_P(PSTR("AT+CMGS="), telno)) {
+    goto cmd_error;
+  }
+  ts_max = _clock->millis() + 4000;
   if (!waitForPrompt("> ", ts_max)) {
     goto cmd_error;
   }
   _modemStream->print(text); //the message itself
   _modemStream->print((char)26); //the ASCII code of ctrl+z is 26, this is needed to end the send modus and send the message.
+  countTx(strlen(text) + 1);
   if (!waitForOK(30000)) {
     goto cmd_error;
   }
@@ -868,7 +961,6 @@ cmd_error:
   diagPrintLn(F("sendSMS failed!"));
 
 ending:
-  off();
   return retval;
 }
 
@@ -885,75 +977,8 @@ ending:
  */
 bool SIMx00::doHTTPPOSTmiddle(const char *url, const char * contentType, const char * userdata, const char *buffer, size_t len, int *responseStatus)
 {
-  uint32_t ts_max;
-  bool retval = false;
-  char num_bytes[16];
-
-  // set http param URL value
-  /*sendCommandProlog();
-  sendCommandAdd_P(PSTR("AT+HTTPPARA=\"URL\",\""));
-  sendCommandAdd(url);
-  sendCommandAdd('"');
-  sendCommandEpilog();
-  if (!waitForOK()) {
-    goto ending;
-  }
-
-  if(strlen(contentType) > 0){
-    sendCommandProlog();
-    sendCommandAdd_P(PSTR("AT+HTTPPARA=\"CONTENT\",\""));
-    sendCommandAdd(contentType);
-    sendCommandAdd('"');
-    sendCommandEpilog();
-    if(!waitForOK()) {
-      goto ending;
-    }
-  }
-
-  if(strlen(userdata) > 0){
-    sendCommandProlog();
-    sendCommandAdd_P(PSTR("AT+HTTPPARA=\"USERDATA\",\""));
-    sendCommandAdd(userdata);
-    sendCommandAdd('"');
-    sendCommandEpilog();
-    if(!waitForOK()) {
-      goto ending;
-    }
-  }*/
-
-  if(!setHTTPParamsSession(url, contentType, userdata)){
-    goto ending;
-  }
-
-  sendCommandProlog();
-  sendCommandAdd_P(PSTR("AT+HTTPDATA="));
-  itoa(len, num_bytes, 10);
-  sendCommandAdd(num_bytes);
-  sendCommandAdd_P(PSTR(",10000"));
-  sendCommandEpilog();
-  ts_max = millis() + 4000;
-  if (!waitForMessage_P(PSTR("DOWNLOAD"), ts_max)) {
-    goto ending;
-  }
-
-  // Send data ...
-  for (size_t i = 0; i < len; ++i) {
-    _modemStream->print(*buffer++);
-  }
-
-  if (!waitForOK()) {
-    goto ending;
-  }
-
-  if (!doHTTPACTION(1, responseStatus)) {
-    goto ending;
-  }
-
-  // All is well if we get here.
-  retval = true;
-
-ending:
-  return retval;
+  SIMCOM_BufferBody body(buffer, len);
+  return doHTTPPOSTmiddle(url, contentType, userdata, body, responseStatus);
 }
 
 /*!
@@ -969,9 +994,8 @@ ending:
  */
 bool SIMx00::doHTTPPOSTmiddle(const char *url, const char * contentType, const char * userdata, Stream * streamReader, size_t len, int *responseStatus)
 {
-  uint32_t ts_max;
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;
-  char num_bytes[16];
 
   // set http param URL value
   /*sendCommandProlog();
@@ -1009,14 +1033,7 @@ bool SIMx00::doHTTPPOSTmiddle(const char *url, const char * contentType, const c
     goto ending;
   }
 
-  sendCommandProlog();
-  sendCommandAdd_P(PSTR("AT+HTTPDATA="));
-  itoa(len, num_bytes, 10);
-  sendCommandAdd(num_bytes);
-  sendCommandAdd_P(PSTR(",10000"));
-  sendCommandEpilog();
-  ts_max = millis() + 4000;
-  if (!waitForMessage_P(PSTR("DOWNLOAD"), ts_max)) {
+  if (!startHTTPDATA(len)) {
     goto ending;
   }
 
@@ -1024,6 +1041,7 @@ bool SIMx00::doHTTPPOSTmiddle(const char *url, const char * contentType, const c
   for (size_t i = 0; i < len; ++i) {
     _modemStream->print((char)streamReader->read());
   }
+  countTx(len);
 
   if (!waitForOK()) {
     goto ending;
@@ -1053,9 +1071,25 @@ ending:
  */
 bool SIMx00::doHTTPSPOSTmiddle(const char *url, const char * contentType, const char * userdata, const char *buffer, size_t len, int *responseStatus)
 {
-  uint32_t ts_max;
+  SIMCOM_BufferBody body(buffer, len);
+  return doHTTPSPOSTmiddle(url, contentType, userdata, body, responseStatus);
+}
+
+/*!
+ * \brief The middle part of the whole HTTP POST
+ *
+ * This function does:
+ *  - HTTPPARA with the URL
+ *  - HTTPPARA with the Content-Type if is passed
+ *  - HTTPPARA with Userdata (header options) if is passed
+ *  - HTTPDATA  
+ *  - HTTPACTION(1)
+ *  - Return HttpStatus if int is passed
+ */
+bool SIMx00::doHTTPSPOSTmiddle(const char *url, const char * contentType, const char * userdata, Stream * streamReader, size_t len, int *responseStatus)
+{
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;
-  char num_bytes[16];
 
   if(!setHTTPParamsSession(url, contentType, userdata, true)){
     goto ending;
@@ -1066,21 +1100,15 @@ bool SIMx00::doHTTPSPOSTmiddle(const char *url, const char * contentType, const
     goto ending;
   }
 
-  sendCommandProlog();
-  sendCommandAdd_P(PSTR("AT+HTTPDATA="));
-  itoa(len, num_bytes, 10);
-  sendCommandAdd(num_bytes);
-  sendCommandAdd_P(PSTR(",10000"));
-  sendCommandEpilog();
-  ts_max = millis() + 4000;
-  if (!waitForMessage_P(PSTR("DOWNLOAD"), ts_max)) {
+  if (!startHTTPDATA(len)) {
     goto ending;
   }
 
   // Send data ...
   for (size_t i = 0; i < len; ++i) {
-    _modemStream->print(*buffer++);
+    _modemStream->print((char)streamReader->read());
   }
+  countTx(len);
 
   if (!waitForOK()) {
     goto ending;
@@ -1098,45 +1126,77 @@ ending:
 }
 
 /*!
- * \brief The middle part of the whole HTTP POST
+ * \brief The middle part of the whole HTTP POST, with a CBOR body
  *
- * This function does:
- *  - HTTPPARA with the URL
- *  - HTTPPARA with the Content-Type if is passed
- *  - HTTPPARA with Userdata (header options) if is passed
- *  - HTTPDATA  
- *  - HTTPACTION(1)
- *  - Return HttpStatus if int is passed
+ * The body is encoded directly into the modem stream.
  */
-bool SIMx00::doHTTPSPOSTmiddle(const char *url, const char * contentType, const char * userdata, Stream * streamReader, size_t len, int *responseStatus)
+bool SIMx00::doHTTPPOSTmiddle(const char *url, const char * contentType, const char * userdata, SIMCOM_TelemetryEncoder & encoder, int *responseStatus)
 {
-  uint32_t ts_max;
+  SIMCOM_Transaction transaction(*this);
+  SIMCOM_CBORBody body(encoder);
+  return doHTTPPOSTmiddle(url, contentType, userdata, body, responseStatus);
+}
+
+/*!
+ * \brief The middle part of the whole HTTP POST, with a rendered body
+ *
+ * The body is rendered twice: first to compute the length for
+ * HTTPDATA, then to send the bytes directly into the modem stream.
+ * There is no need to have the whole body in RAM.
+ */
+bool SIMx00::doHTTPPOSTmiddle(const char *url, const char * contentType, const char * userdata, SIMCOM_BodyProducer & body, int *responseStatus)
+{
+  SIMCOM_Transaction transaction(*this);
+  return doHTTPPOSTbody(url, contentType, userdata, body, false, responseStatus);
+}
+
+/*!
+ * \brief The middle part of the whole HTTP POST, with a scatter-gather body
+ *
+ * The fragments are sent back to back, HTTPDATA gets the sum of the lengths.
+ */
+bool SIMx00::doHTTPPOSTmiddle(const char *url, const char * contentType, const char * userdata, const SIMCOM_IOVec * iov, size_t nr, int *responseStatus)
+{
+  SIMCOM_Transaction transaction(*this);
+  SIMCOM_IOVecBody body(iov, nr);
+  return doHTTPPOSTbody(url, contentType, userdata, body, false, responseStatus);
+}
+
+bool SIMx00::doHTTPSPOSTmiddle(const char *url, const char * contentType, const char * userdata, SIMCOM_BodyProducer & body, int *responseStatus)
+{
+  SIMCOM_Transaction transaction(*this);
+  return doHTTPPOSTbody(url, contentType, userdata, body, true, responseStatus);
+}
+
+/*!
+ * \brief Do HTTPPARA, HTTPDATA and HTTPACTION(1) with a rendered body
+ */
+bool SIMx00::doHTTPPOSTbody(const char *url, const char * contentType, const char * userdata, SIMCOM_BodyProducer & body, bool ssl, int *responseStatus)
+{
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;
-  char num_bytes[16];
+  size_t len = body.length();
 
-  if(!setHTTPParamsSession(url, contentType, userdata, true)){
+  if(!setHTTPParamsSession(url, contentType, userdata, ssl)){
     goto ending;
   }
 
-  sendCommand_P(PSTR("AT+HTTPSSL=1"));
-  if (!waitForOK()) {
-    goto ending;
+  if (ssl) {
+    sendCommand_P(PSTR("AT+HTTPSSL=1"));
+    if (!waitForOK()) {
+      goto ending;
+    }
   }
 
-  sendCommandProlog();
-  sendCommandAdd_P(PSTR("AT+HTTPDATA="));
-  itoa(len, num_bytes, 10);
-  sendCommandAdd(num_bytes);
-  sendCommandAdd_P(PSTR(",10000"));
-  sendCommandEpilog();
-  ts_max = millis() + 4000;
-  if (!waitForMessage_P(PSTR("DOWNLOAD"), ts_max)) {
+  if (!startHTTPDATA(len)) {
     goto ending;
   }
 
   // Send data ...
-  for (size_t i = 0; i < len; ++i) {
-    _modemStream->print((char)streamReader->read());
+  if (!sendBody(body, len)) {
+    // The modem will not accept it, but we still wait for its reply.
+    waitForOK(12000);
+    goto ending;
   }
 
   if (!waitForOK()) {
@@ -1154,6 +1214,30 @@ ending:
   return retval;
 }
 
+/*!
+ * \brief Render the body into the modem stream
+ *
+ * Returns false if the body did not have the expected length. The
+ * modem gets exactly <len> bytes anyway, cut off or padded with zeros,
+ * otherwise it stays in data mode and takes the next command as data.
+ */
+bool SIMx00::sendBody(SIMCOM_BodyProducer & body, size_t len)
+{
+  SIMCOM_CountingPrint writer(_modemStream);
+  writer.setLimit(len);
+  body.render(writer);
+  if (writer.count() == len) {
+    countTx(len);
+    return true;
+  }
+  diagPrintLn(F("Body length mismatch!"));
+  for (size_t i = writer.count(); i < len; ++i) {
+    _modemStream->write((uint8_t)0);
+  }
+  countTx(len);
+  return false;
+}
+
 /*!
  * \brief The middle part of the whole HTTP POST, with a READ
  *
@@ -1163,6 +1247,7 @@ ending:
  */
 bool SIMx00::doHTTPPOSTmiddleWithReply(const char *url, const char * contentType, const char * userdata, const char *postdata, size_t pdlen, int *responseStatus, char *buffer, size_t len)
 {
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;;
 
   if (!doHTTPPOSTmiddle(url, contentType, userdata, postdata, pdlen, responseStatus)) {
@@ -1192,6 +1277,7 @@ ending:
  */
 bool SIMx00::doHTTPPOSTmiddleWithReply(const char *url, const char * contentType, const char * userdata, Stream * streamReader, size_t pdlen, int *responseStatus, char *buffer, size_t len)
 {
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;;
 
   if (!doHTTPPOSTmiddle(url, contentType, userdata, streamReader, pdlen, responseStatus)) {
@@ -1219,6 +1305,7 @@ ending:
  */
 bool SIMx00::doHTTPSPOSTmiddleWithReply(const char *url, const char * contentType, const char * userdata, const char *postdata, size_t pdlen, int *responseStatus, char *buffer, size_t len)
 {
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;;
 
   if (!doHTTPSPOSTmiddle(url, contentType, userdata, postdata, pdlen, responseStatus)) {
@@ -1246,6 +1333,7 @@ ending:
  */
 bool SIMx00::doHTTPSPOSTmiddleWithReply(const char *url, const char * contentType, const char * userdata, Stream * streamReader, size_t pdlen, int *responseStatus, char *buffer, size_t len)
 {
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;;
 
   if (!doHTTPSPOSTmiddle(url, contentType, userdata, streamReader, pdlen, responseStatus)) {
@@ -1274,15 +1362,11 @@ ending:
  */
 bool SIMx00::doHTTPGETmiddle(const char *url, char *buffer, size_t len)
 {
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;
 
   // set http param URL value
-  sendCommandProlog();
-  sendCommandAdd_P(PSTR("AT+HTTPPARA=\"URL\",\""));
-  sendCommandAdd(url);
-  sendCommandAdd('"');
-  sendCommandEpilog();
-  if (!waitForOK()) {
+  if (!sendQuotedCommandWaitForOK_P(PSTR("AT+HTTPPARA=\"URL\","), url)) {
     goto ending;
   }
 
@@ -1309,6 +1393,7 @@ bool SIMx00::doHTTPprolog(const char *apn)
 
 bool SIMx00::doHTTPprolog(const char *apn, const char *apnuser, const char *apnpwd)
 {
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;
 
   if (!connectProlog()) {
@@ -1338,6 +1423,7 @@ ending:
 
 void SIMx00::doHTTPepilog()
 {
+  SIMCOM_Transaction transaction(*this);
   if (!sendCommandWaitForOK_P(PSTR("AT+HTTPTERM"))) {
     // This is an error, but we can still return success.
   }
@@ -1348,6 +1434,7 @@ void SIMx00::doHTTPepilog()
  */
 bool SIMx00::doHTTPREAD(char *buffer, size_t len)
 {
+  SIMCOM_Transaction transaction(*this);
   uint32_t ts_max;
   size_t getLength = 0;
   int i;
@@ -1358,22 +1445,21 @@ bool SIMx00::doHTTPREAD(char *buffer, size_t len)
   //   <data>
   //   OK
   sendCommand_P(PSTR("AT+HTTPREAD"));
-  ts_max = millis() + 8000;
+  ts_max = _clock->millis() + 8000;
   if (waitForMessage_P(PSTR("+HTTPREAD:"), ts_max)) {
-    const char *ptr = _inputBuffer + 10;
-    char *bufend;
-    getLength = strtoul(ptr, &bufend, 0);
-    if (bufend == ptr) {
+    long dataLength;
+    if (SIMCOM_scanReply(_inputBuffer, PSTR("+HTTPREAD: %l"), &dataLength) != 1 || dataLength < 0) {
       // Invalid number
       goto ending;
     }
+    getLength = dataLength;
   } else {
     // Hmm. Why didn't we get this?
     goto ending;
   }
   // Read the data
   retval = true;                // assume this will succeed
-  ts_max = millis() + 4000;
+  ts_max = _clock->millis() + 4000;
   i = readBytes(getLength, (uint8_t *)buffer, len, ts_max);
   if (i != 0) {
     // We didn't get the bytes that we expected
@@ -1394,6 +1480,7 @@ ending:
 
 bool SIMx00::doHTTPACTION(char num, int * status)
 {
+  SIMCOM_Transaction transaction(*this);
   uint32_t ts_max;
   bool retval = false;
 
@@ -1409,22 +1496,18 @@ bool SIMx00::doHTTPACTION(char num, int * status)
   // <Method> 0
   // <StatusCode> 200
   // <DataLen> ??
-  ts_max = millis() + 20000;
+  ts_max = _clock->millis() + 20000;
   if (waitForMessage_P(PSTR("+HTTPACTION:"), ts_max)) {
     // SIM900 responds with: "+HTTPACTION:1,200,11"
     // SIM800 responds with: "+HTTPACTION: 1,200,11"
-    // The 12 is the length of "+HTTPACTION:"
-    // We then have to skip the digit and the comma
-    const char *ptr = _inputBuffer + 12;
-    ptr = skipWhiteSpace(ptr);
-    ++ptr;              // The digit
-    ++ptr;              // The comma
-    char *bufend;
-    uint16_t replycode = strtoul(ptr, &bufend, 10);
-    if (bufend == ptr) {
+    int replycode;
+    if (SIMCOM_scanReply(_inputBuffer, PSTR("+HTTPACTION: %*,%d"), &replycode) != 1) {
       // Invalid number
       goto ending;
     }
+    if (replycode < 200 || replycode >= 300) {
+      setError(SIMCOM_ERRKIND_HTTP, replycode);
+    }
 
     if(status != NULL){
       *status = replycode;
@@ -1444,38 +1527,22 @@ ending:
 }
 
 bool SIMx00::setHTTPParamsSession(const char * url, const char * contentType, const char * userdata, bool redir){
-  uint32_t ts_max;
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;
-  char num_bytes[16];
 
   // set http param URL value
-  sendCommandProlog();
-  sendCommandAdd_P(PSTR("AT+HTTPPARA=\"URL\",\""));
-  sendCommandAdd(url);
-  sendCommandAdd('"');
-  sendCommandEpilog();
-  if (!waitForOK()) {
+  if (!sendQuotedCommandWaitForOK_P(PSTR("AT+HTTPPARA=\"URL\","), url)) {
     goto ending;
   }
 
   if(strlen(contentType) > 0){
-    sendCommandProlog();
-    sendCommandAdd_P(PSTR("AT+HTTPPARA=\"CONTENT\",\""));
-    sendCommandAdd(contentType);
-    sendCommandAdd('"');
-    sendCommandEpilog();
-    if(!waitForOK()) {
+    if (!sendQuotedCommandWaitForOK_P(PSTR("AT+HTTPPARA=\"CONTENT\","), contentType)) {
       goto ending;
     }
   }
 
   if(strlen(userdata) > 0){
-    sendCommandProlog();
-    sendCommandAdd_P(PSTR("AT+HTTPPARA=\"USERDATA\",\""));
-    sendCommandAdd(userdata);
-    sendCommandAdd('"');
-    sendCommandEpilog();
-    if(!waitForOK()) {
+    if (!sendQuotedCommandWaitForOK_P(PSTR("AT+HTTPPARA=\"USERDATA\","), userdata)) {
       goto ending;
     }
   }
@@ -1493,6 +1560,25 @@ ending:
   return retval;
 }
 
+/*!
+ * \brief Send AT+HTTPDATA and wait until the modem is ready for the data
+ *
+ * After this the caller must send exactly <len> bytes and then wait for "OK".
+ */
+bool SIMx00::startHTTPDATA(size_t len)
+{
+  uint32_t ts_max;
+
+  // The second parameter is the time (ms) the modem waits for all the data
+  sendCommandProlog();
+  sendCommandAdd_P(PSTR("AT+HTTPDATA="));
+  sendCommandAdd((unsigned long)len);
+  sendCommandAdd_P(PSTR(",10000"));
+  sendCommandEpilog();
+  ts_max = _clock->millis() + 4000;
+  return waitForMessage_P(PSTR("DOWNLOAD"), ts_max);
+}
+
 bool SIMx00::doHTTPPOST(const char *apn, const char *url, const char * contentType, const char * userdata, const char *postdata, size_t pdlen, int * responseStatus)
 {
   return doHTTPPOST(apn, 0, 0, url, contentType, userdata, postdata, pdlen, responseStatus);
@@ -1501,6 +1587,7 @@ bool SIMx00::doHTTPPOST(const char *apn, const char *url, const char * contentTy
 bool SIMx00::doHTTPPOST(const char *apn, const char *apnuser, const char *apnpwd,
     const char *url, const char * contentType, const char * userdata, const char *postdata, size_t pdlen, int * responseStatus)
 {
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;
 
   if (!on()) {
@@ -1523,7 +1610,7 @@ cmd_error:
   diagPrintLn(F("doHTTPPOST failed!"));
 
 ending:
-  off();
+  offOrSleep(retval);
   return retval;
 }
 
@@ -1537,6 +1624,7 @@ bool SIMx00::doHTTPPOSTWithReply(const char *apn,
 bool SIMx00::doHTTPPOSTWithReply(const char *apn, const char *apnuser, const char *apnpwd,
     const char *url, const char * contentType, const char * userdata, const char *postdata, size_t pdlen, int * responseStatus, char *buffer, size_t len)
 {
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;
 
   if (!on()) {
@@ -1559,7 +1647,7 @@ cmd_error:
   diagPrintLn(F("doHTTPGET failed!"));
 
 ending:
-  off();
+  offOrSleep(retval);
   return retval;
 }
 
@@ -1576,6 +1664,7 @@ bool SIMx00::doHTTPGET(const char *apn, const String & url, char *buffer, size_t
 bool SIMx00::doHTTPGET(const char *apn, const char *apnuser, const char *apnpwd,
     const char *url, char *buffer, size_t len)
 {
+  SIMCOM_Transaction transaction(*this);
   bool retval = false;
 
   if (!on()) {
@@ -1598,15 +1687,65 @@ cmd_error:
   diagPrintLn(F("doHTTPGET failed!"));
 
 ending:
-  off();
+  offOrSleep(retval);
   return retval;
 }
 
+/*
+ * \brief Query the bearer (AT+SAPBR=2,1)
+ *
+ * Returns true if it is connected.
+ */
+bool SIMx00::isBearerOpen()
+{
+  SIMCOM_Transaction transaction(*this);
+  int status = 0;
+
+  // Expect +SAPBR: <cid>,<Status>,<IP_Addr>
+  sendCommand_P(PSTR("AT+SAPBR=2,1"));
+  if (waitForMessage_P(PSTR("+SAPBR:"), _clock->millis() + 4000)) {
+    SIMCOM_scanReply(_inputBuffer, PSTR("+SAPBR: %*,%d"), &status);
+  }
+  return waitForOK() && status == 1;
+}
+
+/*
+ * \brief A fingerprint of the bearer parameters (FNV-1a)
+ *
+ * Cheaper in RAM than a copy of the strings. Never 0, that means unknown.
+ */
+static uint32_t bearerKey(const char *apn, const char *user, const char *pwd)
+{
+  const char *parms[] = { apn, user, pwd };
+  uint32_t key = 2166136261UL;
+  for (size_t i = 0; i < sizeof(parms) / sizeof(parms[0]); ++i) {
+    const char *ptr = parms[i] ? parms[i] : "";
+    do {
+      key = (key ^ (uint8_t)*ptr) * 16777619UL;
+    } while (*ptr++);
+  }
+  return key ? key : 1;
+}
+
 bool SIMx00::setBearerParms(const char *apn, const char *user, const char *pwd)
 {
-  char cmd[64];
   bool retval = false;
-  int retry;
+  bool ok = false;
+  uint32_t key = bearerKey(apn, user, pwd);
+
+  // After a sleep (see offOrSleep) the bearer is still open, and
+  // SAPBR=1 would fail. Keep it if it was opened with these parameters,
+  // otherwise close it first.
+  if (isBearerOpen()) {
+    if (key == _bearerKey) {
+      return true;
+    }
+    _bearerKey = 0;
+    if (!sendCommandWaitForOK_P(PSTR("AT+SAPBR=0,1"), 10000)) {
+      goto ending;
+    }
+  }
+  _bearerKey = 0;
 
   // SAPBR=3 Set bearer parameters
   if (!sendCommandWaitForOK_P(PSTR("AT+SAPBR=3,1,\"CONTYPE\",\"GPRS\""))) {
@@ -1614,40 +1753,35 @@ bool SIMx00::setBearerParms(const char *apn, const char *user, const char *pwd)
   }
 
   // SAPBR=3 Set bearer parameters
-  strcpy_P(cmd, PSTR("AT+SAPBR=3,1,\"APN\",\""));
-  strcat(cmd, apn);
-  strcat(cmd, "\"");
-  if (!sendCommandWaitForOK(cmd)) {
+  if (!sendQuotedCommandWaitForOK_P(PSTR("AT+SAPBR=3,1,\"APN\","), apn)) {
     goto ending;
   }
   if (user && user[0]) {
-    strcpy_P(cmd, PSTR("AT+SAPBR=3,1,\"USER\",\""));
-    strcat(cmd, user);
-    strcat(cmd, "\"");
-    if (!sendCommandWaitForOK(cmd)) {
+    if (!sendQuotedCommandWaitForOK_P(PSTR("AT+SAPBR=3,1,\"USER\","), user)) {
       goto ending;
     }
   }
   if (pwd && pwd[0]) {
-    strcpy_P(cmd, PSTR("AT+SAPBR=3,1,\"PWD\",\""));
-    strcat(cmd, pwd);
-    strcat(cmd, "\"");
-    if (!sendCommandWaitForOK(cmd)) {
+    if (!sendQuotedCommandWaitForOK_P(PSTR("AT+SAPBR=3,1,\"PWD\","), pwd)) {
       goto ending;
     }
   }
 
   // SAPBR=1 Open bearer
   // This command can fail if signal quality is low, or if we're too fast
-  for (retry = 0; retry < 5; retry++) {
-    if (sendCommandWaitForOK_P(PSTR("AT+SAPBR=1,1"),10000)) {
-      break;
+  {
+    SIMCOM_Retry retry(SIMCOM_RETRY_BEARER, getRetryPolicy(SIMCOM_RETRY_BEARER), _clock->millis());
+    while (!ok && nextAttempt(retry)) {
+      ok = sendCommandWaitForOK_P(PSTR("AT+SAPBR=1,1"), 10000);
     }
+    retryDone(retry, ok);
   }
-  if (retry >= 5) {
+  if (!ok) {
     goto ending;
   }
 
+  _bearerKey = key;
+
   // SAPBR=2 Query bearer
   // Expect +SAPBR: <cid>,<Status>,<IP_Addr>
   if (!sendCommandWaitForOK_P(PSTR("AT+SAPBR=2,1"))) {
@@ -1662,62 +1796,71 @@ ending:
 
 bool SIMx00::getIMEI(char *buffer, size_t buflen)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 2000;
+  uint32_t ts_max = _clock->millis() + 2000;
   return getStrValue("AT+GSN", buffer, buflen, ts_max);
 }
 
 bool SIMx00::getGCAP(char *buffer, size_t buflen)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 2000;
+  uint32_t ts_max = _clock->millis() + 2000;
   return getStrValue_P(PSTR("AT+GCAP"), PSTR("+GCAP:"), buffer, buflen, ts_max);
 }
 
 bool SIMx00::getCIMI(char *buffer, size_t buflen)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 2000;
+  uint32_t ts_max = _clock->millis() + 2000;
   return getStrValue("AT+CIMI", buffer, buflen, ts_max);
 }
 
 bool SIMx00::getCCID(char *buffer, size_t buflen)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 2000;
+  uint32_t ts_max = _clock->millis() + 2000;
   return getStrValue("AT+CCID", buffer, buflen, ts_max);
 }
 
 bool SIMx00::getCLIP(char *buffer, size_t buflen)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 4000;
+  uint32_t ts_max = _clock->millis() + 4000;
   return getStrValue_P(PSTR("AT+CLIP?"), PSTR("+CLIP:"), buffer, buflen, ts_max);
 }
 
 bool SIMx00::getCLIR(char *buffer, size_t buflen)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 4000;
+  uint32_t ts_max = _clock->millis() + 4000;
   return getStrValue_P(PSTR("AT+CLIR?"), PSTR("+CLIR:"), buffer, buflen, ts_max);
 }
 
 bool SIMx00::getCOLP(char *buffer, size_t buflen)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 4000;
+  uint32_t ts_max = _clock->millis() + 4000;
   return getStrValue_P(PSTR("AT+COLP?"), PSTR("+COLP:"), buffer, buflen, ts_max);
 }
 
 bool SIMx00::getCOPS(char *buffer, size_t buflen)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 4000;
+  uint32_t ts_max = _clock->millis() + 4000;
   return getStrValue_P(PSTR("AT+COPS?"), PSTR("+COPS:"), buffer, buflen, ts_max);
 }
 
 bool SIMx00::setCCLK(const SIMCOMDateTime & dt)
 {
+  SIMCOM_Transaction transaction(*this);
   String str;
   str.reserve(30);
   dt.addToString(str);
@@ -1732,27 +1875,31 @@ bool SIMx00::setCCLK(const SIMCOMDateTime & dt)
 
 bool SIMx00::getCCLK(char *buffer, size_t buflen)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 4000;
+  uint32_t ts_max = _clock->millis() + 4000;
   return getStrValue_P(PSTR("AT+CCLK?"), PSTR("+CCLK:"), buffer, buflen, ts_max);
 }
 
 bool SIMx00::getCSPN(char *buffer, size_t buflen)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 4000;
+  uint32_t ts_max = _clock->millis() + 4000;
   return getStrValue_P(PSTR("AT+CSPN?"), PSTR("+CSPN:"), buffer, buflen, ts_max);
 }
 
 bool SIMx00::getCGID(char *buffer, size_t buflen)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 4000;
+  uint32_t ts_max = _clock->millis() + 4000;
   return getStrValue_P(PSTR("AT+CGID"), PSTR("+GID:"), buffer, buflen, ts_max);
 }
 
 bool SIMx00::setCIURC(uint8_t value)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
   sendCommandProlog();
   sendCommandAdd_P(PSTR("AT+CIURC="));
@@ -1763,8 +1910,9 @@ bool SIMx00::setCIURC(uint8_t value)
 
 bool SIMx00::getCIURC(char *buffer, size_t buflen)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 4000;
+  uint32_t ts_max = _clock->millis() + 4000;
   return getStrValue_P(PSTR("AT+CIURC?"), PSTR("+CIURC:"), buffer, buflen, ts_max);
 }
 
@@ -1778,6 +1926,7 @@ bool SIMx00::getCIURC(char *buffer, size_t buflen)
  */
 bool SIMx00::setCFUN(uint8_t value)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
   sendCommandProlog();
   sendCommandAdd_P(PSTR("AT+CFUN="));
@@ -1788,8 +1937,9 @@ bool SIMx00::setCFUN(uint8_t value)
 
 bool SIMx00::getCFUN(uint8_t * value)
 {
+  SIMCOM_Transaction transaction(*this);
   switchEchoOff();
-  uint32_t ts_max = millis() + 4000;
+  uint32_t ts_max = _clock->millis() + 4000;
   int tmpValue;
   bool status;
   status = getIntValue_P(PSTR("AT+CFUN?"), PSTR("+CFUN:"), &tmpValue, ts_max);
@@ -1801,24 +1951,28 @@ bool SIMx00::getCFUN(uint8_t * value)
 
 void SIMx00::enableLTS()
 {
+  SIMCOM_Transaction transaction(*this);
   if (!sendCommandWaitForOK_P(PSTR("AT+CLTS=1"), 6000)) {
   }
 }
 
 void SIMx00::disableLTS()
 {
+  SIMCOM_Transaction transaction(*this);
   if (!sendCommandWaitForOK_P(PSTR("AT+CLTS=0"), 6000)) {
   }
 }
 
 void SIMx00::enableCIURC()
 {
+  SIMCOM_Transaction transaction(*this);
   if (!sendCommandWaitForOK_P(PSTR("AT+CIURC=1"), 6000)) {
   }
 }
 
 void SIMx00::disableCIURC()
 {
+  SIMCOM_Transaction transaction(*this);
   if (!sendCommandWaitForOK_P(PSTR("AT+CIURC=0"), 6000)) {
   }
 }
@@ -1835,10 +1989,11 @@ void SIMx00::disableCIURC()
 bool SIMx00::getPII(char *buffer, size_t buflen)
 {
   switchEchoOff();
-  uint32_t ts_max = millis() + 2000;
+  uint32_t ts_max = _clock->millis() + 2000;
   return getStrValue("ATI", buffer, buflen, ts_max);
 }
 
+#if SIMCOM_MODEM_PRODUCT == SIMCOM_PRODUCT_AUTO
 void SIMx00::setProductId()
 {
   char buffer[64];
@@ -1851,6 +2006,7 @@ void SIMx00::setProductId()
     }
   }
 }
+#endif
 
 const char * SIMx00::skipWhiteSpace(const char * txt)
 {
@@ -1862,18 +2018,26 @@ const char * SIMx00::skipWhiteSpace(const char * txt)
 
 uint32_t SIMx00::getUnixEpoch()
 {
+  SIMCOM_Transaction transaction(*this);
   bool status;
   char buffer[64];
 
   status = false;
-  for (uint8_t ix = 0; !status && ix < 10; ++ix) {
+  SIMCOM_Retry onRetry(SIMCOM_RETRY_POWERON, getRetryPolicy(SIMCOM_RETRY_POWERON), _clock->millis());
+  while (!status && nextAttempt(onRetry)) {
     status = on();
+    if (!status) {
+      setError(SIMCOM_ERRKIND_TIMEOUT);
+    }
   }
+  retryDone(onRetry, status);
 
   status = false;
-  for (uint8_t ix = 0; !status && ix < 10; ++ix) {
+  SIMCOM_Retry cclkRetry(SIMCOM_RETRY_CCLK, getRetryPolicy(SIMCOM_RETRY_CCLK), _clock->millis());
+  while (!status && nextAttempt(cclkRetry)) {
     status = getCCLK(buffer, sizeof(buffer));
   }
+  retryDone(cclkRetry, status);
 
   const char * ptr = buffer;
   if (*ptr == '"') {
@@ -26,6 +26,8 @@
 #include <Stream.h>
 
 #include "SIMCOM_Modem.h"
+#include "SIMCOM_Body.h"
+#include "SIMCOM_Encoder.h"
 
 
 // Comment this line, or make it an undef to disable
@@ -33,11 +35,27 @@
 #define ENABLE_GPRSBEE_DIAG     1
 
 /*!
- * \def SIM900_DEFAULT_BUFFER_SIZE
+ * \def SIMCOM_MODEM_PRODUCT
+ *
+ * The module, if it is known at build time. By default (SIMCOM_PRODUCT_AUTO)
+ * it is asked with ATI when the first connection is made. With another
+ * value that is skipped, and the code for it is left out.
+ * E.g. add -DSIMCOM_MODEM_PRODUCT=SIMCOM_PRODUCT_SIM800 to the build flags.
+ */
+#define SIMCOM_PRODUCT_AUTO     0
+#define SIMCOM_PRODUCT_SIM900   1
+#define SIMCOM_PRODUCT_SIM800   2
+#ifndef SIMCOM_MODEM_PRODUCT
+#define SIMCOM_MODEM_PRODUCT    SIMCOM_PRODUCT_AUTO
+#endif
+
+/*!
+ * \def SIMCOM_MODEM_DEFAULT_BUFFER_SIZE
  *
  * The GPRSbee class uses an internal buffer to read lines from
  * the SIMx00. The buffer is allocated in .init() and the default
- * size is what this define is set to.
+ * size is what this define is set to. SIMx00T has the buffer as
+ * member instead.
  *
  * The function .readline() is the only function that writes to this
  * internal buffer.
@@ -74,6 +92,10 @@ public:
   
   bool doHTTPPOSTmiddle(const char *url, const char * contentType, const char * userdata, const char *postdata, size_t pdlen, int * responseStatus);
   bool doHTTPPOSTmiddle(const char *url, const char * contentType, const char * userdata, Stream * streamReader, size_t pdlen, int * responseStatus);
+  bool doHTTPPOSTmiddle(const char *url, const char * contentType, const char * userdata, SIMCOM_TelemetryEncoder & encoder, int * responseStatus);
+  bool doHTTPPOSTmiddle(const char *url, const char * contentType, const char * userdata, SIMCOM_BodyProducer & body, int * responseStatus);
+  bool doHTTPSPOSTmiddle(const char *url, const char * contentType, const char * userdata, SIMCOM_BodyProducer & body, int * responseStatus);
+  bool doHTTPPOSTmiddle(const char *url, const char * contentType, const char * userdata, const SIMCOM_IOVec * iov, size_t nr, int * responseStatus);
   bool doHTTPSPOSTmiddle(const char *url, const char * contentType, const char * userdata, const char *postdata, size_t pdlen, int * responseStatus);
   bool doHTTPSPOSTmiddle(const char *url, const char * contentType, const char * userdata, Stream * streamReader, size_t pdlen, int * responseStatus);
 
@@ -109,6 +131,8 @@ public:
   void closeTCP(bool switchOff=true);
   bool isTCPConnected();
   bool sendDataTCP(const uint8_t *data, size_t data_len);
+  bool sendDataTCP(SIMCOM_BodyProducer & body);
+  bool sendDataTCP(const SIMCOM_IOVec * iov, size_t nr);
   bool receiveDataTCP(uint8_t *data, size_t data_len, uint16_t timeout=4000);
   bool receiveLineTCP(const char **buffer, uint16_t timeout=4000);
 
@@ -123,6 +147,10 @@ public:
   bool closeFTPfile();
 
   bool sendSMS(const char *telno, const char *text);
+  // Like sendSMS, but the modem is left as it was: on, asleep or off.
+  // Use this in a job that can run inside another operation, see
+  // SIMCOM_CommandScheduler.
+  bool sendSMSKeepPower(const char *telno, const char *text);
 
   // Get the Received Signal Strength Indication and Bit Error Rate
   bool getRSSIAndBER(int8_t* rssi, uint8_t* ber);
@@ -175,14 +203,22 @@ protected:
   void toggle();
 
   void switchEchoOff();  
+  bool inDataMode() { return _transMode; }
 
   bool connectProlog();
   bool waitForSignalQuality();
   bool waitForCREG();
   bool setBearerParms(const char *apn, const char *user, const char *pwd);
+  bool isBearerOpen();
+  bool startHTTPDATA(size_t len);
+  bool doHTTPPOSTbody(const char *url, const char * contentType, const char * userdata, SIMCOM_BodyProducer & body, bool ssl, int * responseStatus);
+  bool sendBody(SIMCOM_BodyProducer & body, size_t len);
+  bool sendSMSmiddle(const char *telno, const char *text);
 
   bool getPII(char *buffer, size_t buflen);
+#if SIMCOM_MODEM_PRODUCT == SIMCOM_PRODUCT_AUTO
   void setProductId();
+#endif
 
   
 
@@ -193,6 +229,7 @@ protected:
   
   size_t _ftpMaxLength;
   bool _transMode;
+  uint32_t _bearerKey;          // the parameters the bearer was opened with, see setBearerParms()
   bool _skipCGATT;
   bool _changedSkipCGATT;		// This is set when the user has changed it.
   enum productIdKind {
@@ -207,6 +244,27 @@ protected:
 
 };
 
+/*!
+ * \brief A SIMx00 with the input buffer as member
+ *
+ * The size of the input (line) buffer is a template parameter. Use
+ * this instead of the malloc'd buffer of SIMx00 to have the RAM
+ * accounted for at link time, and to avoid the heap altogether.
+ *   SIMx00T<128> gprsbee;
+ *   gprsbee.init(Serial1, onoff);
+ */
+template <size_t LineSize = SIMCOM_MODEM_DEFAULT_BUFFER_SIZE>
+class SIMx00T : public SIMx00
+{
+public:
+  SIMx00T() { setInputBuffer(_line, LineSize); }
+
+  void init(Stream & stream, SIMCOM_Modem_OnOff &onoff) { SIMx00::init(stream, onoff, LineSize); }
+
+private:
+  char _line[LineSize];
+};
+
 //extern SIMx00 gprsbee;
 
 #endif /* SIMX00_H_ */